@@ -0,0 +1,378 @@
+#ifndef PROCESSOR_HPP
+#define PROCESSOR_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <cstdio>
+#include "procsim.hpp"
+#include "procsim_trace.hpp"
+#include "procsim_retire_log.hpp"
+#include "procsim_telemetry.hpp"
+
+// Function Unit structure
+struct FU {
+    bool busy;                   // Blocking FUs: held from fire until the result is broadcast
+    uint64_t executing_tag;      // Tag of instruction using this FU (blocking FUs)
+    uint64_t next_issue_cycle;   // Pipelined FUs: first cycle a new instruction may issue
+};
+
+// Result buses (CDBs) - track instructions waiting to broadcast results
+struct ResultBusEntry {
+    uint64_t tag;
+    int32_t dest_reg;
+    uint64_t completed_cycle;  // Cycle the instruction completed (queue key, with tag)
+    int32_t fu_type;           // FU holding the result until it is broadcast
+    int32_t fu_id;
+    int32_t phys_dest;         // Physical register written (-1 = none / no PRF)
+    int32_t thread;            // Hardware thread whose register dest_reg is
+    bool granted;              // Won result-bus arbitration this cycle (broadcasts in execute_stage)
+};
+
+// Ordered completion queue: fixed-capacity ring of completed instructions waiting for a
+// result bus. Entries are appended as they complete (cycle by cycle, tag order within a
+// cycle), so the ring is always sorted by (completed_cycle, tag) without any sorting.
+// An instruction keeps its RS entry until it broadcasts (a pipelined FU may be free long
+// before), so at most RS_SIZE entries can be pending and the ring is sized to the RS.
+struct CompletionQueue {
+    std::vector<ResultBusEntry> slots;
+    size_t head;
+    size_t count;
+
+    void reset(size_t capacity) { slots.assign(capacity > 0 ? capacity : 1, ResultBusEntry()); head = 0; count = 0; }
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    ResultBusEntry& operator[](size_t i) { return slots[(head + i) % slots.size()]; }
+    ResultBusEntry& front() { return slots[head]; }
+    void push_back(const ResultBusEntry& entry) { slots[(head + count) % slots.size()] = entry; count++; }
+    void pop_front() { head = (head + 1) % slots.size(); count--; }
+};
+
+// Reorder buffer: ring of dispatched instructions in tag order. An entry is filled in when
+// its result is broadcast (and its RS entry freed) and leaves from the head, in order, at
+// commit. Tags are dispatched consecutively, so an entry is found by its distance from the head.
+struct ReorderBuffer {
+    std::vector<proc_inst_t> slots;
+    std::vector<char> done;        // Result broadcast, ready to commit
+    size_t head;
+    size_t count;
+    uint64_t head_tag;             // Tag of the entry at head
+
+    void reset(size_t capacity) { slots.assign(capacity, proc_inst_t()); done.assign(capacity, 0); head = 0; count = 0; head_tag = 0; }
+    size_t capacity() const { return slots.size(); }
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    bool front_done() const { return count > 0 && done[head]; }
+    proc_inst_t& front() { return slots[head]; }
+    void push_back(uint64_t tag) { if (count == 0) head_tag = tag; done[(head + count) % slots.size()] = 0; count++; }
+    void complete(const proc_inst_t& inst) { size_t i = (head + (inst.tag - head_tag)) % slots.size(); slots[i] = inst; done[i] = 1; }
+    void pop_front() { done[head] = 0; head = (head + 1) % slots.size(); head_tag++; count--; }
+};
+
+// Free list of physical registers: bit p set = register p is free. Allocation takes the
+// lowest free register at or after a rotating word hint, so it is a couple of word scans.
+struct FreeList {
+    std::vector<uint64_t> bits;
+    size_t free_count;
+    size_t hint;                   // Word to start the next search at
+
+    void reset(size_t num_regs, size_t first_free)
+    {
+        bits.assign((num_regs + 63) / 64, 0);
+        for (size_t p = first_free; p < num_regs; p++) bits[p >> 6] |= (uint64_t)1 << (p & 63);
+        free_count = num_regs - first_free;
+        hint = 0;
+    }
+    int32_t alloc()
+    {
+        for (size_t n = 0; n < bits.size(); n++, hint = (hint + 1) % bits.size()) {
+            if (bits[hint] != 0) {
+                int32_t p = (int32_t)(hint * 64 + __builtin_ctzll(bits[hint]));
+                bits[hint] &= bits[hint] - 1;
+                free_count--;
+                return p;
+            }
+        }
+        return -1;
+    }
+    void release(int32_t p) { bits[p >> 6] |= (uint64_t)1 << (p & 63); free_count++; }
+};
+
+// Instruction source: fills p_inst with the next trace instruction, false at end of trace
+typedef bool (*inst_source_fn)(void* ctx, proc_inst_t* p_inst);
+
+// One hardware thread: its instruction source, dispatch queue and rename state. The back
+// end (RS, FUs, result buses, ROB, physical registers) is shared by all threads.
+struct HwThread {
+    // Instruction source: a callback, or the built-in span / stream reader when it is NULL
+    inst_source_fn source;
+    void* source_ctx;
+    const trace_bin_record_t* span_records;   // set_source_span
+    const trace_dep_record_t* span_deps;      // set_source_span, annotated records
+    size_t span_count;
+    size_t span_next;
+    FILE* stream;                             // set_source_stream
+    bool stream_binary;
+    bool stream_deps;                         // Annotated binary trace
+    uint64_t stream_remaining;
+
+    std::deque<proc_inst_t> dispatch_queue;
+    bool trace_done;                  // Every instruction of the trace fetched
+
+    // Register file state - track ready bits and producer tags for each register (0-127)
+    bool reg_ready[128];              // true if register value is ready
+    uint64_t reg_producer[128];       // Tag of instruction that will produce the value (0 if no pending producer)
+    int32_t rename_map[NUM_ARCH_REGS];   // Architectural -> physical register (PRF only)
+
+    uint64_t rs_count;                // Entries in the RS (ICOUNT)
+    uint64_t fetched;
+    uint64_t retired;
+};
+
+/**
+ * One simulated processor. All pipeline state lives in the instance, so any number of
+ * processors can run side by side (e.g. one per thread in a design-space sweep) or be
+ * embedded in other tools through libprocsim.
+ *
+ * Typical use:
+ *   Processor proc;
+ *   proc.set_source_span(records, count);   // or set_source / set_source_stream
+ *   proc.setup(r, k0, k1, k2, f);
+ *   while (!proc.done()) proc.step(10000);  // or proc.run(&stats)
+ *   proc.get_stats(&stats);
+ *   if (proc.stuck()) ...                   // the run stopped making progress
+ *
+ * The library never exits or prints on its own; a stuck run is only reported through
+ * stuck() (and run()'s result), and dump_state() describes it.
+ */
+class Processor {
+public:
+    Processor();
+
+    /*
+     * Instruction sources (pick one before running; without a source the trace is empty)
+     */
+
+    // Callback: source(ctx, p_inst) returns the next instruction, false at end of trace
+    void set_source(inst_source_fn source, void* ctx) { set_source(0, source, ctx); }
+
+    // Span: binary trace records already in memory (not copied; must outlive the run)
+    void set_source_span(const trace_bin_record_t* records, size_t count) { set_source_span(0, records, count); }
+    void set_source_span(const trace_dep_record_t* records, size_t count) { set_source_span(0, records, count); }
+
+    // Stream: text or binary (trace2bin) trace read from an open FILE, format detected
+    // from the magic number. Returns false on a corrupt binary header.
+    //
+    // Annotated records (trace_dep_record_t) carry their producer distances: with one
+    // thread and no PRF, dispatch takes the dependences from them instead of renaming.
+    bool set_source_stream(FILE* stream) { return set_source_stream(0, stream); }
+
+    // SMT: threads hardware threads share the back end, each with its own source (the
+    // source setters above feed thread 0). Call before setting the sources of threads > 0.
+    void set_smt(unsigned threads, smt_fetch_policy_t policy);
+    void set_source(unsigned thread, inst_source_fn source, void* ctx);
+    void set_source_span(unsigned thread, const trace_bin_record_t* records, size_t count);
+    void set_source_span(unsigned thread, const trace_dep_record_t* records, size_t count);
+    bool set_source_stream(unsigned thread, FILE* stream);
+
+    /*
+     * Simulation
+     */
+
+    void setup(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f);
+    uint64_t step(uint64_t cycles);     // Simulate up to cycles cycles, returns cycles simulated
+    bool done();                        // Trace exhausted and every instruction retired, or stuck()
+    bool run(proc_stats_t* p_stats);    // Step until done, false if the pipeline got stuck
+    bool stuck() const;                 // No progress for RUNAWAY_CYCLES and nothing in flight
+    void dump_state(FILE* out) const;   // Pipeline state, for reporting a stuck run
+    void complete(proc_stats_t* p_stats);
+    void set_idle_skip(bool enable);    // Jump over cycles in which nothing can change
+    void set_fu_timing(int type, const fu_timing_t& timing);   // Call before setup()
+    void set_dispatch_capacity(uint64_t capacity);             // 0 = unbounded; call before setup()
+    void set_retire_log(FILE* out);     // Stream per-instruction timelines (NULL = off); before setup()
+    void set_interval_log(FILE* out, uint64_t interval);   // CSV row every interval cycles; before setup()
+    void set_pipeline_trace(FILE* out); // Chrome trace-event JSON timeline (NULL = off); before setup()
+    void set_rob(uint64_t size, uint64_t commit_width);    // In-order commit (size 0 = off); before setup()
+    void set_prf(uint64_t size);        // Physical registers, > NUM_ARCH_REGS (0 = unlimited); before setup()
+    void set_rs_size(uint64_t size);    // Unified RS entries (0 = 2 * (k0 + k1 + k2)); before setup()
+    void set_rs_queues(uint64_t q0, uint64_t q1, uint64_t q2);  // Per-FU-type RS queues (0 = 2 * k); before setup()
+    uint64_t rs_entries(uint64_t k0, uint64_t k1, uint64_t k2) const;   // RS size setup() would allocate
+    uint64_t settings_hash() const;     // Hash of the settings above that change results (result cache key)
+
+    /*
+     * Statistics queries
+     */
+
+    void get_stats(proc_stats_t* p_stats) const;   // Snapshot of the statistics so far
+    uint64_t cycle_count() const { return current_cycle; }
+    uint64_t fetched_count() const { return instructions_fetched; }
+    uint64_t retired_count() const { return instructions_retired; }
+    uint64_t thread_retired_count(unsigned thread) const { return threads[thread].retired; }
+    uint64_t skipped_count() const { return cycles_skipped; }   // Cycles jumped over as idle
+
+private:
+    // Stage functions
+    void cycle();
+    void fetch_stage();
+    void dispatch_stage();
+    void schedule_stage();
+    void execute_stage();
+    void state_update_stage();
+    void commit_stage();
+    disp_slot_t dispatch_stall(const HwThread& thread, uint64_t rs_free, const uint64_t* queue_free,
+                               uint64_t rob_free, uint64_t prf_free) const;
+    disp_slot_t dispatch_stall_all(uint64_t rs_free, const uint64_t* queue_free, uint64_t rob_free,
+                                   uint64_t prf_free, size_t* stalled) const;
+    uint64_t rs_free_slots(uint64_t* queue_free) const;
+    void count_dispatch_stall(disp_slot_t blocked, size_t stalled, uint64_t cycles);
+    int fetch_thread() const;
+    bool fetch_blocked(const HwThread& thread) const;
+    bool next_instruction(HwThread& thread, proc_inst_t* p_inst);
+    uint64_t dispatch_queue_size() const;
+    void rename(HwThread& thread, proc_inst_t& inst);
+    void retire(proc_inst_t& inst);
+    void arbitrate_result_buses();
+    void update_stats();
+    bool all_instructions_retired();
+    void rs_push(const proc_inst_t& inst);
+    bool rs_holds(uint64_t tag) const;
+    void rs_compact(const uint64_t* remove_bits);
+    bool issue_pending() const;
+    uint64_t next_completion_cycle() const;
+    uint64_t idle_cycles_ahead();
+    bool fu_available(int type, const FU& fu) const;
+    void skip_cycles(uint64_t cycles);
+    interval_totals_t interval_totals() const;
+    void account_dispatch_slots(uint64_t dispatched, disp_slot_t blocked, uint64_t cycles);
+    void account_issue_slots(int type, uint64_t fired, const uint64_t* unfired_ready, uint64_t cycles);
+
+    // Hardware threads (one unless set_smt was called)
+    std::vector<HwThread> threads;
+    smt_fetch_policy_t fetch_policy;
+    size_t fetch_rr;                 // Round-robin fetch: next thread to try
+    size_t dispatch_rr;              // Thread dispatch starts with this cycle (rotates)
+
+    bool idle_skip;                  // Event-horizon cycle skipping enabled
+
+    // Processor configuration parameters
+    uint64_t R;              // Number of result buses
+    uint64_t k0;             // Number of k0 function units
+    uint64_t k1;             // Number of k1 function units
+    uint64_t k2;             // Number of k2 function units
+    uint64_t F;              // Fetch width (instructions per cycle)
+    uint64_t RS_SIZE;        // Reservation station size (default 2 * (k0 + k1 + k2), sum of the queues if distributed)
+    fu_timing_t fu_timing[3];  // Latency and issue interval per FU type
+    uint64_t dispatch_capacity;  // Dispatch queue size limit (0 = unbounded); fetch stalls when full
+    uint64_t rob_size;           // Reorder buffer entries (0 = retire directly from the RS)
+    uint64_t commit_width;       // ROB commits per cycle (0 = F)
+    uint64_t prf_size;           // Physical registers (0 = implicit renaming through reg_producer)
+    uint64_t rs_size_config;     // Unified RS entries requested (0 = 2 * (k0 + k1 + k2))
+    bool rs_distributed;         // One RS queue per FU type instead of a unified RS
+    uint64_t rs_queue_config[3]; // Queue entries requested per FU type (0 = 2 * k)
+    uint64_t rs_queue_size[3];   // Queue entries per FU type (distributed RS only)
+
+    // Reservation station (RS)
+    // Entries are appended in dispatch (= tag) order and removed with a stable compaction,
+    // so RS index order is always tag order. A distributed RS shares this storage: each FU
+    // type's queue is the set of entries in its rs_type_bits mask, capped at rs_queue_size,
+    // so the FUs of a type only ever look at their own queue.
+    std::vector<proc_inst_t> reservation_station;
+
+    // Columnar mirror of the RS hot fields, index-aligned with reservation_station.
+    // The producer columns are authoritative after dispatch: a producer tag is zeroed
+    // (woken up) when that producer broadcasts, so an operand is ready when its lane is 0.
+    std::vector<uint64_t> rs_tag;             // Tag of each RS entry
+    std::vector<uint64_t> rs_src_producer0;   // Pending producer of src_reg[0] (0 = available)
+    std::vector<uint64_t> rs_src_producer1;   // Pending producer of src_reg[1] (0 = available)
+
+    // RS status bitmasks (bit i = RS entry i), all bits at or above reservation_station.size() are 0
+    size_t rs_mask_words;                     // Words per mask = mask_words(RS_SIZE)
+    std::vector<uint64_t> rs_ready_bits;      // ready_to_fire, latched by schedule_stage
+    std::vector<uint64_t> rs_fired_bits;      // fired
+    std::vector<uint64_t> rs_completed_bits;  // completed
+    std::vector<uint64_t> rs_broadcast_bits;  // result_broadcast
+    std::vector<uint64_t> rs_type_bits[3];    // fu_type == 0 / 1 / 2
+    std::vector<uint64_t> rs_zero_bits;       // Always 0 (neutral operand for simd_mask_select)
+    std::vector<uint64_t> rs_scratch_bits;    // Per-stage temporary (candidates / removals)
+    std::vector<uint64_t> rs_granted_bits;    // Result holds a result bus this cycle
+    uint64_t rs_type_count[3];                // RS entries per FU type (= occupancy of each queue)
+
+    // Function units
+    std::vector<FU> fu_type0;  // k0 function units
+    std::vector<FU> fu_type1;  // k1 function units
+    std::vector<FU> fu_type2;  // k2 function units
+
+    // Reorder buffer (rob_size > 0 only)
+    ReorderBuffer rob;
+    
+    CompletionQueue result_buses;  // Instructions waiting to broadcast, ordered by (completed_cycle, tag)
+
+    // In-flight completion calendar: timing wheel of fired instruction tags, slot = completion
+    // cycle mod wheel size (a power of two >= the RS size, which bounds the instructions in
+    // flight), so the execute stage touches only the instructions completing this cycle.
+    // Completions a full turn or more ahead wait in a min-heap instead, and a bitmap of the
+    // occupied slots finds the next booked completion without visiting empty slots.
+    typedef std::pair<uint64_t, uint64_t> far_completion_t;     // (completion cycle, tag)
+    std::vector<std::vector<uint64_t>> completion_wheel;
+    std::vector<uint64_t> wheel_occupied;
+    std::priority_queue<far_completion_t, std::vector<far_completion_t>, std::greater<far_completion_t>>
+        far_completions;
+    uint64_t wheel_mask;
+    uint64_t in_flight;              // Instructions fired but not yet completed
+
+    // Explicit renaming (prf_size > 0 only): the producer tag of every physical register
+    // (0 = value available) and the free list; each thread has its own rename_map
+    std::vector<uint64_t> phys_producer;
+    FreeList prf_free_list;
+    // Without a ROB instructions retire out of order, so the next writer of a register may
+    // retire before its producer: the register is then freed when the producer retires
+    std::vector<char> phys_unretired;    // Producer allocated at rename, not yet retired
+    std::vector<char> phys_free_pending; // Superseded by a retired writer, free once unretired clears
+
+    // Processor state
+    uint64_t current_cycle;          // Current simulation cycle
+    uint64_t next_tag;               // Next instruction tag to assign at dispatch (starts at 1)
+    uint64_t instructions_fetched;   // Total instructions fetched
+    uint64_t instructions_retired;   // Total instructions retired
+    uint64_t last_progress_cycle;    // Latest cycle an instruction fired, completed or retired (runaway detection)
+    uint64_t rs_slots_available_this_cycle;  // RS slots available at start of cycle (before state_update frees slots)
+    uint64_t rs_queue_available_this_cycle[3];  // Same per FU type queue (distributed RS only)
+    uint64_t rob_slots_available_this_cycle; // ROB slots available at start of cycle (before commit frees slots)
+    uint64_t prf_available_this_cycle;       // Free physical registers at start of cycle (retire frees late)
+
+    // Timeline output of retired instructions (off unless set_retire_log was called)
+    FILE* retire_log_out;
+    RetireLog retire_log;
+    
+    // Interval time series (off unless set_interval_log was called)
+    FILE* interval_log_out;
+    uint64_t interval_log_cycles;
+    IntervalLog interval_log;
+    
+    // Chrome trace-event timeline (off unless set_pipeline_trace was called)
+    FILE* pipeline_trace_out;
+    PipelineTrace pipeline_trace;
+
+    // Statistics tracking per cycle
+    uint64_t inst_fired_this_cycle;      // Number of instructions fired this cycle
+    uint64_t inst_retired_this_cycle;    // Number of instructions retired this cycle
+    uint64_t total_inst_fired;           // Total instructions fired across all cycles
+    uint64_t total_disp_size_sum;        // Sum of dispatch queue sizes for averaging
+    uint64_t total_rs_size_sum;          // Sum of RS occupancies (interval telemetry)
+    uint64_t max_disp_size;              // Largest dispatch queue size seen
+    uint64_t cycles_skipped;             // Idle cycles advanced analytically (skip_cycles)
+    uint64_t fetch_stall_cycles;         // Cycles fetch was held back by a full dispatch queue
+    uint64_t disp_full_cycles;           // Cycles ending with the dispatch queue full
+    uint64_t rob_full_cycles;            // Cycles in which dispatch was stopped by a full ROB
+    uint64_t prf_full_cycles;            // Cycles in which dispatch was stopped by an empty free list
+    uint64_t rs_full_cycles[3];          // Cycles in which dispatch was stopped by a full RS, by FU type
+    uint64_t disp_slot_count[NUM_DISP_SLOTS];        // Top-down dispatch slot accounting
+    uint64_t issue_slot_count[3][NUM_ISSUE_SLOTS];   // Top-down issue slot accounting per FU type
+    uint64_t bus_broadcasts;             // Results granted a result bus
+    uint64_t bus_full_cycles;            // Cycles with more waiting results than result buses
+};
+
+#endif /* PROCESSOR_HPP */
@@ -1,76 +1,305 @@
 #include "procsim.hpp"
+#include "processor.hpp"
+#include "procsim_simd.hpp"
+#include "procsim_trace.hpp"
+#include "procsim_cache.hpp"
 #include <algorithm>
 #include <deque>
-#include <set>
-#include <tuple>
 #include <vector>
 #include <cstdio>
+#include <cstdlib>
+#include <cstdint>
 
-// Function Unit structure
-struct FU {
-    bool busy;
-    uint64_t executing_tag;      // Tag of instruction using this FU
-    int cycles_remaining;        // For latency tracking
-};
-
-// Global processor configuration parameters
-uint64_t R;              // Number of result buses
-uint64_t k0;             // Number of k0 function units
-uint64_t k1;             // Number of k1 function units
-uint64_t k2;             // Number of k2 function units
-uint64_t F;              // Fetch width (instructions per cycle)
-uint64_t RS_SIZE;        // Reservation station size = 2 * (k0 + k1 + k2)
-
-// Global dispatch queue
-std::deque<proc_inst_t> dispatch_queue;
-
-// Global reservation station (RS)
-std::vector<proc_inst_t> reservation_station;
-
-// Global function units
-std::vector<FU> fu_type0;  // k0 function units
-std::vector<FU> fu_type1;  // k1 function units
-std::vector<FU> fu_type2;  // k2 function units
-
-// Global result buses (CDBs) - track instructions waiting to broadcast results
-struct ResultBusEntry {
-    uint64_t tag;
-    int32_t dest_reg;
-};
-std::deque<ResultBusEntry> result_buses;  // Stores instruction tags and dest_regs waiting to broadcast (tag order)
-
-// Track tags that have broadcast their results (for WAW hazard handling)
-std::set<uint64_t> tags_broadcast;  // Set of tags that have successfully broadcast
-
-// Global register file state - track ready bits and producer tags for each register (0-127)
-bool reg_ready[128];              // true if register value is ready
-uint64_t reg_producer[128];       // Tag of instruction that will produce the value (0 if no pending producer)
-
-// Global processor state
-uint64_t current_cycle;          // Current simulation cycle
-uint64_t next_tag;               // Next instruction tag to assign (starts at 1)
-bool trace_done;                 // Flag indicating all instructions fetched
-uint64_t instructions_fetched;   // Total instructions fetched
-uint64_t instructions_retired;   // Total instructions retired
-uint64_t rs_slots_available_this_cycle;  // RS slots available at start of cycle (before state_update frees slots)
-
-// Store retired instructions for output
-std::vector<proc_inst_t> retired_instructions;
-
-// Statistics tracking per cycle
-uint64_t inst_fired_this_cycle;      // Number of instructions fired this cycle
-uint64_t inst_retired_this_cycle;    // Number of instructions retired this cycle
-uint64_t total_inst_fired;           // Total instructions fired across all cycles
-uint64_t total_disp_size_sum;        // Sum of dispatch queue sizes for averaging
-
-// Forward declarations for stage functions
-void fetch_stage();
-void dispatch_stage();
-void schedule_stage();
-void execute_stage();
-void state_update_stage();
-void update_stats(proc_stats_t* p_stats);
-bool all_instructions_retired();
+Processor::Processor()
+    : threads(1), fetch_policy(SMT_FETCH_ROUND_ROBIN), fetch_rr(0), dispatch_rr(0), idle_skip(true),
+      dispatch_capacity(DEFAULT_DISPATCH_CAPACITY), rob_size(DEFAULT_ROB_SIZE),
+      commit_width(DEFAULT_COMMIT_WIDTH), prf_size(DEFAULT_PRF_SIZE), rs_size_config(0),
+      rs_distributed(false), retire_log_out(NULL), interval_log_out(NULL), interval_log_cycles(0),
+      pipeline_trace_out(NULL)
+{
+    for (int t = 0; t < 3; t++) {
+        fu_timing[t].latency = DEFAULT_FU_LATENCY;
+        fu_timing[t].interval = DEFAULT_FU_INTERVAL;
+        rs_queue_config[t] = 0;
+    }
+}
+
+/**
+ * Set the latency and issue interval of one FU type (takes effect at the next setup())
+ * @type FU type (0, 1 or 2)
+ * @timing latency >= 1; interval 0 = blocking, N = a new instruction every N cycles
+ */
+void Processor::set_fu_timing(int type, const fu_timing_t& timing)
+{
+    if (type < 0 || type > 2) {
+        return;
+    }
+    fu_timing[type] = timing;
+    if (fu_timing[type].latency == 0) {
+        fu_timing[type].latency = 1;
+    }
+}
+
+/**
+ * Limit the dispatch queue (takes effect at the next setup()). Fetch stalls while the
+ * queue is full, so memory stays flat however far the front end runs ahead.
+ * @capacity Maximum queue entries, 0 = unbounded (the original behavior)
+ */
+void Processor::set_dispatch_capacity(uint64_t capacity)
+{
+    dispatch_capacity = capacity;
+}
+
+/**
+ * Add a reorder buffer (takes effect at the next setup()). Dispatch then also needs a
+ * free ROB entry; an instruction leaves the RS when its result is broadcast but retires
+ * only from the ROB head, in order, at most commit_width per cycle.
+ * @size ROB entries, 0 = no ROB (out-of-order retirement from the RS, the original model)
+ * @commit_width Commits per cycle, 0 = the fetch width F
+ */
+void Processor::set_rob(uint64_t size, uint64_t commit_width)
+{
+    rob_size = size;
+    this->commit_width = commit_width;
+}
+
+/**
+ * Rename onto a finite physical register file (takes effect at the next setup()). Every
+ * instruction with a destination takes a free physical register at dispatch, which
+ * stalls when none is free, and the register previously mapped to that destination
+ * returns to the free list when the instruction retires.
+ * @size Physical registers, 0 = implicit renaming (unlimited registers, the original
+ *       model); otherwise raised to at least NUM_ARCH_REGS + 1
+ */
+void Processor::set_prf(uint64_t size)
+{
+    prf_size = (size > 0 && size <= NUM_ARCH_REGS) ? NUM_ARCH_REGS + 1 : size;
+}
+
+/**
+ * Use a unified reservation station of the given size (takes effect at the next setup())
+ * @size RS entries, 0 = 2 * (k0 + k1 + k2) (the original sizing)
+ */
+void Processor::set_rs_size(uint64_t size)
+{
+    rs_size_config = size;
+    rs_distributed = false;
+}
+
+/**
+ * Split the reservation station into one issue queue per FU type (takes effect at the
+ * next setup()). Dispatch stays in order: the head instruction stalls while the queue of
+ * its FU type is full, even if the other queues have room.
+ * @q0, q1, q2 Queue entries for FU types 0, 1 and 2; 0 = 2 * the FUs of that type
+ */
+void Processor::set_rs_queues(uint64_t q0, uint64_t q1, uint64_t q2)
+{
+    rs_queue_config[0] = q0;
+    rs_queue_config[1] = q1;
+    rs_queue_config[2] = q2;
+    rs_distributed = true;
+}
+
+/**
+ * Total RS entries of a configuration under the current RS settings
+ */
+uint64_t Processor::rs_entries(uint64_t k0, uint64_t k1, uint64_t k2) const
+{
+    if (!rs_distributed) {
+        return (rs_size_config > 0) ? rs_size_config : 2 * (k0 + k1 + k2);
+    }
+    const uint64_t k[3] = { k0, k1, k2 };
+    uint64_t total = 0;
+    for (int t = 0; t < 3; t++) {
+        total += (rs_queue_config[t] > 0) ? rs_queue_config[t] : 2 * k[t];
+    }
+    return total;
+}
+
+/**
+ * Hash of every pre-setup setting that can change the statistics of a run: FU timing,
+ * dispatch capacity, ROB, PRF, RS sizing and SMT. Outputs and idle skipping are left out.
+ */
+uint64_t Processor::settings_hash() const
+{
+    uint64_t values[] = {
+        fu_timing[0].latency, fu_timing[0].interval, fu_timing[1].latency, fu_timing[1].interval,
+        fu_timing[2].latency, fu_timing[2].interval, dispatch_capacity, rob_size, commit_width,
+        prf_size, rs_size_config, rs_distributed, rs_queue_config[0], rs_queue_config[1],
+        rs_queue_config[2], threads.size(), (uint64_t)fetch_policy
+    };
+    return fnv1a_64(values, sizeof(values));
+}
+
+/**
+ * Stream the FETCH/DISP/SCHED/EXEC/STATE timeline of every instruction to out, in tag
+ * order, as instructions retire (takes effect at the next setup(); complete() closes it)
+ * @out Destination, NULL = no log (the default)
+ */
+void Processor::set_retire_log(FILE* out)
+{
+    retire_log_out = out;
+}
+
+/**
+ * Write a time series of the run: one CSV row per interval cycles with IPC, fire rate,
+ * RS occupancy, dispatch queue depth and result-bus usage (takes effect at the next
+ * setup(); complete() writes the last, partial interval)
+ * @out Destination, NULL = no time series (the default)
+ * @interval Cycles per row (0 = off)
+ */
+void Processor::set_interval_log(FILE* out, uint64_t interval)
+{
+    interval_log_out = out;
+    interval_log_cycles = interval;
+}
+
+/**
+ * Export the pipeline timeline as Chrome trace-event JSON (instruction stages, FU
+ * occupancy, result-bus counters), streamed as instructions retire (takes effect at the
+ * next setup(); complete() closes the JSON)
+ * @out Destination, NULL = no trace (the default)
+ */
+void Processor::set_pipeline_trace(FILE* out)
+{
+    pipeline_trace_out = out;
+}
+
+/**
+ * Run several hardware threads on the one back end (takes effect at the next setup()).
+ * Each thread has its own trace, dispatch queue and rename state; the RS, FUs, result
+ * buses, ROB and physical registers are shared. One thread fetches per cycle, chosen by
+ * the fetch policy, and dispatch takes one instruction from each thread in turn.
+ * @threads Hardware threads, 1 to MAX_SMT_THREADS (1 = no SMT, the default)
+ * @policy Which thread fetches each cycle
+ */
+void Processor::set_smt(unsigned threads, smt_fetch_policy_t policy)
+{
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > MAX_SMT_THREADS) {
+        threads = MAX_SMT_THREADS;
+    }
+    this->threads.resize(threads);
+    fetch_policy = policy;
+}
+
+/*
+ * Instruction sources
+ */
+
+void Processor::set_source(unsigned thread, inst_source_fn source, void* ctx)
+{
+    if (thread >= threads.size()) {
+        return;
+    }
+    HwThread& th = threads[thread];
+    th.source = source;
+    th.source_ctx = ctx;
+    th.span_records = NULL;
+    th.span_deps = NULL;
+    th.stream = NULL;
+}
+
+void Processor::set_source_span(unsigned thread, const trace_bin_record_t* records, size_t count)
+{
+    if (thread >= threads.size()) {
+        return;
+    }
+    set_source(thread, NULL, NULL);
+    HwThread& th = threads[thread];
+    th.span_records = records;
+    th.span_count = count;
+    th.span_next = 0;
+}
+
+void Processor::set_source_span(unsigned thread, const trace_dep_record_t* records, size_t count)
+{
+    if (thread >= threads.size()) {
+        return;
+    }
+    set_source(thread, NULL, NULL);
+    HwThread& th = threads[thread];
+    th.span_deps = records;
+    th.span_count = count;
+    th.span_next = 0;
+}
+
+bool Processor::set_source_stream(unsigned thread, FILE* stream)
+{
+    if (thread >= threads.size()) {
+        return false;
+    }
+    set_source(thread, NULL, NULL);
+    HwThread& th = threads[thread];
+    th.stream = stream;
+    th.stream_binary = false;
+    th.stream_deps = false;
+    th.stream_remaining = 0;
+    
+    // A binary trace is recognized by its magic number, anything else is parsed as text
+    int c = getc(stream);
+    if (c != EOF) {
+        ungetc(c, stream);
+    }
+    if (c == (unsigned char)TRACE_BIN_MAGIC[0]) {
+        trace_bin_header_t header;
+        if (fread(&header, sizeof(header), 1, stream) != 1 || !trace_bin_header_valid(&header)) {
+            return false;
+        }
+        th.stream_binary = true;
+        th.stream_deps = trace_bin_has_deps(&header);
+        th.stream_remaining = header.record_count;
+    }
+    return true;
+}
+
+/**
+ * Read the next instruction of a thread from its callback, span or stream
+ * @return false at the end of the trace (or if the thread has no source)
+ */
+bool Processor::next_instruction(HwThread& thread, proc_inst_t* p_inst)
+{
+    if (thread.source != NULL) {
+        return thread.source(thread.source_ctx, p_inst);
+    }
+    if (thread.span_records != NULL) {
+        if (thread.span_next >= thread.span_count) {
+            return false;
+        }
+        trace_bin_decode(&thread.span_records[thread.span_next++], p_inst);
+        return true;
+    }
+    if (thread.span_deps != NULL) {
+        if (thread.span_next >= thread.span_count) {
+            return false;
+        }
+        trace_dep_decode(&thread.span_deps[thread.span_next++], p_inst);
+        return true;
+    }
+    if (thread.stream != NULL) {
+        if (thread.stream_deps) {
+            trace_dep_record_t rec;
+            if (thread.stream_remaining == 0 || fread(&rec, sizeof(rec), 1, thread.stream) != 1) {
+                return false;
+            }
+            thread.stream_remaining--;
+            trace_dep_decode(&rec, p_inst);
+            return true;
+        }
+        if (thread.stream_binary) {
+            trace_bin_record_t rec;
+            if (thread.stream_remaining == 0 || fread(&rec, sizeof(rec), 1, thread.stream) != 1) {
+                return false;
+            }
+            thread.stream_remaining--;
+            trace_bin_decode(&rec, p_inst);
+            return true;
+        }
+        return trace_text_read(thread.stream, p_inst);
+    }
+    return false;
+}
 
 /**
  * Subroutine for initializing the processor. You many add and initialize any global or heap
@@ -83,85 +312,211 @@ bool all_instructions_retired();
  * @k2 Number of k2 FUs
  * @f Number of instructions to fetch
  */
-void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f) 
+void Processor::setup(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f) 
 {
     // Store configuration parameters
-    ::R = r;
-    ::k0 = k0;
-    ::k1 = k1;
-    ::k2 = k2;
-    ::F = f;
+    this->R = r;
+    this->k0 = k0;
+    this->k1 = k1;
+    this->k2 = k2;
+    this->F = f;
     
-    // Calculate reservation station size
-    RS_SIZE = 2 * (::k0 + ::k1 + ::k2);
+    // Calculate reservation station size: unified, or the sum of the per-FU-type queues
+    uint64_t num_fus[3] = { k0, k1, k2 };
+    if (rs_distributed) {
+        RS_SIZE = 0;
+        for (int t = 0; t < 3; t++) {
+            rs_queue_size[t] = (rs_queue_config[t] > 0) ? rs_queue_config[t] : 2 * num_fus[t];
+            RS_SIZE += rs_queue_size[t];
+        }
+    } else {
+        RS_SIZE = (rs_size_config > 0) ? rs_size_config : 2 * (k0 + k1 + k2);
+        for (int t = 0; t < 3; t++) {
+            rs_queue_size[t] = RS_SIZE;
+        }
+    }
     
-    // Initialize dispatch queue (empty, unlimited size)
-    dispatch_queue.clear();
+    // Initialize the threads: empty dispatch queues (at most dispatch_capacity entries each,
+    // 0 = unlimited), nothing fetched yet
+    for (HwThread& thread : threads) {
+        thread.dispatch_queue.clear();
+        thread.trace_done = false;
+        thread.rs_count = 0;
+        thread.fetched = 0;
+        thread.retired = 0;
+    }
+    fetch_rr = 0;
+    dispatch_rr = 0;
     
     // Initialize reservation station (empty, fixed size = RS_SIZE)
     reservation_station.clear();
     reservation_station.reserve(RS_SIZE);
+    rs_tag.clear();
+    rs_tag.reserve(RS_SIZE);
+    rs_src_producer0.clear();
+    rs_src_producer0.reserve(RS_SIZE);
+    rs_src_producer1.clear();
+    rs_src_producer1.reserve(RS_SIZE);
+    
+    // Initialize RS status bitmasks (sized once, never reallocated while running)
+    rs_mask_words = mask_words(RS_SIZE) > 0 ? mask_words(RS_SIZE) : 1;
+    rs_ready_bits.assign(rs_mask_words, 0);
+    rs_fired_bits.assign(rs_mask_words, 0);
+    rs_completed_bits.assign(rs_mask_words, 0);
+    rs_broadcast_bits.assign(rs_mask_words, 0);
+    for (int t = 0; t < 3; t++) {
+        rs_type_bits[t].assign(rs_mask_words, 0);
+        rs_type_count[t] = 0;
+    }
+    rs_zero_bits.assign(rs_mask_words, 0);
+    rs_scratch_bits.assign(rs_mask_words, 0);
+    rs_granted_bits.assign(rs_mask_words, 0);
+    
+    // Pick the SIMD kernels for this host
+    simd_init();
     
     // Initialize function units (all busy = false)
-    fu_type0.resize(::k0);
-    for (size_t i = 0; i < ::k0; i++) {
+    fu_type0.resize(k0);
+    for (size_t i = 0; i < k0; i++) {
         fu_type0[i].busy = false;
         fu_type0[i].executing_tag = 0;
-        fu_type0[i].cycles_remaining = 0;
+        fu_type0[i].next_issue_cycle = 0;
     }
     
-    fu_type1.resize(::k1);
-    for (size_t i = 0; i < ::k1; i++) {
+    fu_type1.resize(k1);
+    for (size_t i = 0; i < k1; i++) {
         fu_type1[i].busy = false;
         fu_type1[i].executing_tag = 0;
-        fu_type1[i].cycles_remaining = 0;
+        fu_type1[i].next_issue_cycle = 0;
     }
     
-    fu_type2.resize(::k2);
-    for (size_t i = 0; i < ::k2; i++) {
+    fu_type2.resize(k2);
+    for (size_t i = 0; i < k2; i++) {
         fu_type2[i].busy = false;
         fu_type2[i].executing_tag = 0;
-        fu_type2[i].cycles_remaining = 0;
+        fu_type2[i].next_issue_cycle = 0;
     }
     
-    // Initialize result buses (empty, can hold up to R instructions per cycle)
-    result_buses.clear();
+    // Initialize the reorder buffer (unused when rob_size == 0)
+    rob.reset(rob_size);
+    
+    // Initialize result buses (empty, broadcasts up to R instructions per cycle)
+    // Every waiting result is still in the RS, so RS_SIZE entries always suffice
+    result_buses.reset(RS_SIZE);
     
-    // Initialize broadcast tracking (empty)
-    tags_broadcast.clear();
+    // Initialize the completion calendar: every fired instruction is still in the RS, so
+    // RS_SIZE slots cover the in-flight instructions at one per cycle (and at least one
+    // bitmap word); latencies beyond a turn of the wheel go to far_completions
+    uint64_t wheel_size = 64;
+    while (wheel_size < RS_SIZE) {
+        wheel_size <<= 1;
+    }
+    completion_wheel.assign(wheel_size, std::vector<uint64_t>());
+    wheel_occupied.assign(mask_words(wheel_size), 0);
+    far_completions = decltype(far_completions)();
+    wheel_mask = wheel_size - 1;
+    in_flight = 0;
     
     // Initialize register file (all registers start as ready, no pending producers)
-    for (int i = 0; i < 128; i++) {
-        reg_ready[i] = true;
-        reg_producer[i] = 0;  // 0 means no pending producer
+    for (HwThread& thread : threads) {
+        for (int i = 0; i < 128; i++) {
+            thread.reg_ready[i] = true;
+            thread.reg_producer[i] = 0;  // 0 means no pending producer
+        }
+    }
+    
+    // Initialize explicit renaming: architectural register a of thread t starts in physical
+    // register t * NUM_ARCH_REGS + a, with its value available; the rest of the PRF is free
+    if (prf_size > 0) {
+        uint64_t arch_regs = NUM_ARCH_REGS * threads.size();
+        if (prf_size <= arch_regs) {
+            prf_size = arch_regs + 1;
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            for (int a = 0; a < NUM_ARCH_REGS; a++) {
+                threads[t].rename_map[a] = (int32_t)(t * NUM_ARCH_REGS + a);
+            }
+        }
+        phys_producer.assign(prf_size, 0);
+        prf_free_list.reset(prf_size, arch_regs);
+        phys_unretired.assign(prf_size, 0);
+        phys_free_pending.assign(prf_size, 0);
+    } else {
+        phys_producer.clear();
+        prf_free_list.reset(0, 0);
+        phys_unretired.clear();
+        phys_free_pending.clear();
     }
     
-    // Initialize global state
+    // Initialize processor state
     current_cycle = 0;
     next_tag = 1;
-    trace_done = false;
     instructions_fetched = 0;
     instructions_retired = 0;
+    last_progress_cycle = 0;
     rs_slots_available_this_cycle = RS_SIZE;  // Initially all slots available
+    for (int t = 0; t < 3; t++) {
+        rs_queue_available_this_cycle[t] = rs_queue_size[t];
+    }
+    rob_slots_available_this_cycle = rob_size;
+    prf_available_this_cycle = prf_free_list.free_count;
+    
+    // Initialize statistics
+    inst_fired_this_cycle = 0;
+    inst_retired_this_cycle = 0;
+    total_inst_fired = 0;
+    total_disp_size_sum = 0;
+    max_disp_size = 0;
+    cycles_skipped = 0;
+    fetch_stall_cycles = 0;
+    disp_full_cycles = 0;
+    rob_full_cycles = 0;
+    prf_full_cycles = 0;
+    for (int t = 0; t < 3; t++) {
+        rs_full_cycles[t] = 0;
+    }
+    for (int i = 0; i < NUM_DISP_SLOTS; i++) {
+        disp_slot_count[i] = 0;
+    }
+    for (int t = 0; t < 3; t++) {
+        for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+            issue_slot_count[t][i] = 0;
+        }
+    }
+    bus_broadcasts = 0;
+    bus_full_cycles = 0;
+    
+    // Start the timeline log (the reorder window only ever spans the RS)
+    retire_log.open(retire_log_out, RS_SIZE);
+    
+    // Start the interval time series
+    total_rs_size_sum = 0;
+    interval_log.open(interval_log_out, interval_log_cycles, R);
     
-    // Initialize retired instructions storage
-    retired_instructions.clear();
+    // Start the trace-event timeline
+    pipeline_trace.open(pipeline_trace_out, num_fus, fu_timing);
 }
 
 /**
  * Helper function to check if all instructions have been retired
  * @return true if all instructions are retired, false otherwise
  */
-bool all_instructions_retired()
+bool Processor::all_instructions_retired()
 {
     // All instructions are retired when:
-    // 1. Trace is done (all instructions fetched)
-    // 2. Dispatch queue is empty
+    // 1. Trace is done (all instructions fetched), for every thread
+    // 2. Dispatch queues are empty
     // 3. Reservation station is empty
     // 4. All function units are free
     // 5. Result buses are empty
+    // (6. With a ROB, every instruction has committed)
     
-    if (!trace_done || !dispatch_queue.empty() || !reservation_station.empty()) {
+    for (const HwThread& thread : threads) {
+        if (!thread.trace_done || !thread.dispatch_queue.empty()) {
+            return false;
+        }
+    }
+    if (!reservation_station.empty() || !rob.empty()) {
         return false;
     }
     
@@ -184,19 +539,119 @@ bool all_instructions_retired()
     return true;
 }
 
+/**
+ * Whether the instruction with this tag is still in the RS (not yet broadcast)
+ */
+bool Processor::rs_holds(uint64_t tag) const
+{
+    if (rs_tag.empty() || tag < rs_tag.front()) {
+        return false;
+    }
+    return std::binary_search(rs_tag.begin(), rs_tag.end(), tag);
+}
+
+/**
+ * Append an instruction to the reservation station and its columnar mirror
+ * @inst Instruction being dispatched (src_producer already resolved)
+ */
+void Processor::rs_push(const proc_inst_t& inst)
+{
+    size_t idx = reservation_station.size();
+    reservation_station.push_back(inst);
+    rs_tag.push_back(inst.tag);
+    rs_src_producer0.push_back(inst.src_producer[0]);
+    rs_src_producer1.push_back(inst.src_producer[1]);
+    
+    // Status bits at idx are already 0 (invariant); only the FU type bit needs setting
+    if (inst.fu_type >= 0 && inst.fu_type < 3) {
+        mask_set(rs_type_bits[inst.fu_type].data(), idx);
+        rs_type_count[inst.fu_type]++;
+    }
+    threads[inst.thread].rs_count++;
+}
+
+/**
+ * Remove the RS entries whose bit is set in remove_bits, keeping the survivors in
+ * tag order. The AoS entries and the columns move a run of survivors at a time, and
+ * every status bitmask is packed a word at a time (simd_mask_compact).
+ * @remove_bits Bitmask of RS indices to drop
+ */
+void Processor::rs_compact(const uint64_t* remove_bits)
+{
+    std::vector<uint64_t>* masks[] = { &rs_ready_bits, &rs_fired_bits, &rs_completed_bits,
+                                       &rs_broadcast_bits, &rs_granted_bits, &rs_type_bits[0],
+                                       &rs_type_bits[1], &rs_type_bits[2] };
+    const size_t num_masks = sizeof(masks) / sizeof(masks[0]);
+    size_t n = reservation_station.size();
+    
+    // Entries before the first removal stay where they are
+    size_t first = 0;
+    while (first < n && !mask_test(remove_bits, first)) {
+        first++;
+    }
+    
+    size_t out = first;
+    for (size_t i = first; i < n;) {
+        if (mask_test(remove_bits, i)) {
+            int32_t type = reservation_station[i].fu_type;
+            if (type >= 0 && type < 3) {
+                rs_type_count[type]--;
+            }
+            threads[reservation_station[i].thread].rs_count--;
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < n && !mask_test(remove_bits, end)) {
+            end++;
+        }
+        std::copy(reservation_station.begin() + i, reservation_station.begin() + end,
+                  reservation_station.begin() + out);
+        std::copy(rs_tag.begin() + i, rs_tag.begin() + end, rs_tag.begin() + out);
+        std::copy(rs_src_producer0.begin() + i, rs_src_producer0.begin() + end, rs_src_producer0.begin() + out);
+        std::copy(rs_src_producer1.begin() + i, rs_src_producer1.begin() + end, rs_src_producer1.begin() + out);
+        out += end - i;
+        i = end;
+    }
+    
+    // Bits past the survivors come out cleared, which keeps the invariant
+    if (out < n) {
+        for (size_t m = 0; m < num_masks; m++) {
+            simd_mask_compact(masks[m]->data(), remove_bits, rs_mask_words);
+        }
+    }
+    
+    reservation_station.resize(out);
+    rs_tag.resize(out);
+    rs_src_producer0.resize(out);
+    rs_src_producer1.resize(out);
+}
+
 /**
  * Update statistics for the current cycle
- * @p_stats Pointer to the statistics structure
  */
-void update_stats(proc_stats_t* p_stats)
+void Processor::update_stats()
 {
     // Track per-cycle statistics
     total_inst_fired += inst_fired_this_cycle;
-    total_disp_size_sum += dispatch_queue.size();
+    uint64_t queued = dispatch_queue_size();
+    total_disp_size_sum += queued;
     
     // Update max dispatch queue size
-    if (dispatch_queue.size() > p_stats->max_disp_size) {
-        p_stats->max_disp_size = dispatch_queue.size();
+    if (queued > max_disp_size) {
+        max_disp_size = queued;
+    }
+    for (const HwThread& thread : threads) {
+        if (dispatch_capacity != 0 && thread.dispatch_queue.size() >= dispatch_capacity) {
+            disp_full_cycles++;
+            break;
+        }
+    }
+    total_rs_size_sum += reservation_station.size();
+    
+    // Close the telemetry interval ending with this cycle
+    if (interval_log.enabled() && current_cycle == interval_log.next_sample()) {
+        interval_log.sample(interval_totals());
     }
     
     // Reset per-cycle counters for next cycle
@@ -207,26 +662,43 @@ void update_stats(proc_stats_t* p_stats)
 /**
  * Fetch stage: Read new instructions from trace
  */
-void fetch_stage()
+void Processor::fetch_stage()
 {
-    // If trace is done, no more instructions to fetch
-    if (trace_done) {
+    // Pick the thread fetching this cycle. None means every trace is done, or every thread
+    // still fetching has a full dispatch queue.
+    int t = fetch_thread();
+    if (t < 0) {
+        for (const HwThread& thread : threads) {
+            if (!thread.trace_done) {
+                fetch_stall_cycles++;
+                break;
+            }
+        }
         return;
     }
+    HwThread& thread = threads[t];
+    fetch_rr = (t + 1) % threads.size();
     
-    // Fetch up to F instructions
+    // Fetch up to F instructions, as long as the dispatch queue has room
     for (uint64_t i = 0; i < F; i++) {
+        if (dispatch_capacity != 0 && thread.dispatch_queue.size() >= dispatch_capacity) {
+            fetch_stall_cycles++;
+            break;
+        }
+        
         proc_inst_t inst;
+        inst.has_src_distance = false;   // Only annotated sources set it
         
-        // Read instruction from trace
-        if (!read_instruction(&inst)) {
+        // Read instruction from trace (no source configured = empty trace)
+        if (!next_instruction(thread, &inst)) {
             // No more instructions available
-            trace_done = true;
+            thread.trace_done = true;
             break;
         }
         
-        // Assign sequential tag
-        inst.tag = next_tag++;
+        // The tag is assigned at dispatch, so the RS and ROB stay in tag order across threads
+        inst.tag = 0;
+        inst.thread = t;
         
         // Set fetch cycle
         inst.fetch_cycle = current_cycle;
@@ -240,7 +712,10 @@ void fetch_stage()
         inst.execute_cycle = 0;
         inst.state_update_cycle = 0;
         inst.completed_cycle = 0;
+        inst.broadcast_cycle = 0;
         inst.fu_id = -1;
+        inst.phys_dest = -1;
+        inst.prev_phys_dest = -1;
         inst.ready_to_fire = false;
         inst.fired = false;
         inst.completed = false;
@@ -258,344 +733,594 @@ void fetch_stage()
         }
         
         // Add to dispatch queue
-        dispatch_queue.push_back(inst);
+        thread.dispatch_queue.push_back(inst);
+        thread.fetched++;
         instructions_fetched++;
     }
 }
 
+/**
+ * @return true if the thread cannot fetch: its trace is done or its dispatch queue is full
+ */
+bool Processor::fetch_blocked(const HwThread& thread) const
+{
+    return thread.trace_done ||
+           (dispatch_capacity != 0 && thread.dispatch_queue.size() >= dispatch_capacity);
+}
+
+/**
+ * Fetch policy: the thread allowed to fetch this cycle. Round-robin takes the next thread
+ * that can fetch; ICOUNT takes the one with the fewest instructions in its dispatch queue
+ * and the RS, ties going to the next in round-robin order.
+ * @return thread index, -1 if no thread can fetch
+ */
+int Processor::fetch_thread() const
+{
+    int best = -1;
+    uint64_t best_count = 0;
+    for (size_t n = 0; n < threads.size(); n++) {
+        size_t t = (fetch_rr + n) % threads.size();
+        if (fetch_blocked(threads[t])) {
+            continue;
+        }
+        if (fetch_policy == SMT_FETCH_ROUND_ROBIN) {
+            return (int)t;
+        }
+        uint64_t count = threads[t].dispatch_queue.size() + threads[t].rs_count;
+        if (best < 0 || count < best_count) {
+            best = (int)t;
+            best_count = count;
+        }
+    }
+    return best;
+}
+
+/**
+ * @return instructions waiting in the dispatch queues of all threads
+ */
+uint64_t Processor::dispatch_queue_size() const
+{
+    uint64_t size = 0;
+    for (const HwThread& thread : threads) {
+        size += thread.dispatch_queue.size();
+    }
+    return size;
+}
+
 /**
  * Dispatch stage: Move instructions from dispatch queue to reservation station
  */
-void dispatch_stage()
+void Processor::dispatch_stage()
 {
     // Process instructions from head to tail (program order)
     // Use rs_slots_available_this_cycle which was captured at start of cycle (before state_update)
     // This implements the half-cycle behavior: dispatch reserves slots in first half,
     // state_update frees slots in second half
     uint64_t slots_remaining = rs_slots_available_this_cycle;
+    uint64_t queue_remaining[3] = { rs_queue_available_this_cycle[0], rs_queue_available_this_cycle[1],
+                                    rs_queue_available_this_cycle[2] };
+    uint64_t rob_remaining = rob_slots_available_this_cycle;
+    uint64_t prf_remaining = prf_available_this_cycle;
+    uint64_t dispatched = 0;
     
-    while (!dispatch_queue.empty() && slots_remaining > 0) {
+    // Threads take turns, one instruction at a time, each in program order until its head
+    // stalls (SMT; a single thread simply dispatches until it stalls)
+    size_t num_threads = threads.size();
+    size_t next = dispatch_rr;
+    size_t stalled_turns = 0;      // Consecutive threads that could not dispatch
+    while (stalled_turns < num_threads) {
+        HwThread& thread = threads[next];
+        next = (next + 1) % num_threads;
+        if (dispatch_stall(thread, slots_remaining, queue_remaining, rob_remaining,
+                           prf_remaining) != DISP_SLOT_USED) {
+            stalled_turns++;
+            continue;
+        }
+        stalled_turns = 0;
+        
         // Get instruction from front of dispatch queue (head)
-        proc_inst_t inst = dispatch_queue.front();
-        dispatch_queue.pop_front();
+        proc_inst_t inst = thread.dispatch_queue.front();
+        thread.dispatch_queue.pop_front();
+        
+        // Assign sequential tag (dispatch order)
+        inst.tag = next_tag++;
         
         // Set schedule cycle (instruction enters RS now, so schedule stage sees it next cycle)
         inst.schedule_cycle = current_cycle + 1;
         
-        // Track source producers at dispatch time
-        // This captures the current producer for each source register
-        // If no producer (reg_ready=true or no register), src_producer=0
-        for (int s = 0; s < 2; s++) {
-            if (inst.src_reg[s] >= 0 && inst.src_reg[s] < 128) {
-                // Always check reg_producer, not reg_ready
-                // reg_producer tracks the latest instruction that will write to this register
-                // Even if reg_ready is true (due to an earlier broadcast), we should wait
-                // for the latest producer if there is one
-                if (reg_producer[inst.src_reg[s]] != 0) {
-                    inst.src_producer[s] = reg_producer[inst.src_reg[s]];  // Wait for this producer
+        if (prf_size > 0) {
+            // Explicit renaming onto the physical register file
+            if (inst.dest_reg >= 0 && inst.dest_reg < NUM_ARCH_REGS) {
+                prf_remaining--;
+            }
+            rename(thread, inst);
+        } else if (inst.has_src_distance && num_threads == 1) {
+            // Annotated trace: with one thread tags follow program order, so the producer
+            // is tag - distance, and it is pending exactly while it is still in the RS
+            // (entries leave the RS in the cycle they broadcast)
+            for (int s = 0; s < 2; s++) {
+                uint64_t distance = inst.src_distance[s];
+                uint64_t producer = inst.tag - distance;
+                inst.src_producer[s] = (distance != 0 && distance < inst.tag && rs_holds(producer)) ? producer : 0;
+            }
+        } else {
+            // Track source producers at dispatch time
+            // This captures the current producer for each source register
+            // If no producer (reg_ready=true or no register), src_producer=0
+            for (int s = 0; s < 2; s++) {
+                if (inst.src_reg[s] >= 0 && inst.src_reg[s] < 128) {
+                    // Always check reg_producer, not reg_ready
+                    // reg_producer tracks the latest instruction that will write to this register
+                    // Even if reg_ready is true (due to an earlier broadcast), we should wait
+                    // for the latest producer if there is one
+                    if (thread.reg_producer[inst.src_reg[s]] != 0) {
+                        inst.src_producer[s] = thread.reg_producer[inst.src_reg[s]];  // Wait for this producer
+                    } else {
+                        inst.src_producer[s] = 0;  // No pending producer
+                    }
                 } else {
-                    inst.src_producer[s] = 0;  // No pending producer
+                    inst.src_producer[s] = 0;  // No register
                 }
-            } else {
-                inst.src_producer[s] = 0;  // No register
             }
-        }
         
-        // Mark destination register as not ready and track this instruction as the producer
-        // This handles WAW: subsequent instructions reading this register will wait for THIS instruction
-        if (inst.dest_reg >= 0 && inst.dest_reg < 128) {
-            reg_ready[inst.dest_reg] = false;
-            reg_producer[inst.dest_reg] = inst.tag;  // Track latest producer
+            // Mark destination register as not ready and track this instruction as the producer
+            // This handles WAW: subsequent instructions reading this register will wait for THIS instruction
+            if (inst.dest_reg >= 0 && inst.dest_reg < 128) {
+                thread.reg_ready[inst.dest_reg] = false;
+                thread.reg_producer[inst.dest_reg] = inst.tag;  // Track latest producer
+            }
         }
         
-        // Move instruction to reservation station
-        reservation_station.push_back(inst);
+        // Move instruction to reservation station (the queue of its FU type)
+        rs_push(inst);
         slots_remaining--;  // Used one slot
+        if (inst.fu_type >= 0 && inst.fu_type < 3) {
+            queue_remaining[inst.fu_type]--;
+        }
+        dispatched++;
+        
+        // Allocate its ROB entry (in tag order)
+        if (rob_size > 0) {
+            rob.push_back(inst.tag);
+            rob_remaining--;
+        }
         
         // Instruction is now in RS (no explicit marking needed, it's in the vector)
     }
     
-    // If RS is full, remaining instructions stay in dispatch queue
+    // If RS, ROB or PRF is full, remaining instructions stay in dispatch queue
     // (handled by the while loop condition)
+    size_t stalled;
+    disp_slot_t blocked = dispatch_stall_all(slots_remaining, queue_remaining, rob_remaining,
+                                             prf_remaining, &stalled);
+    count_dispatch_stall(blocked, stalled, 1);
+    account_dispatch_slots(dispatched, blocked, 1);
+    
+    // The next cycle starts with the next thread
+    if (dispatched > 0) {
+        dispatch_rr = (dispatch_rr + 1) % num_threads;
+    }
 }
 
 /**
- * Schedule stage: Update ready bits for instructions in reservation station
+ * Why the instruction at the head of a thread's dispatch queue cannot dispatch, given the
+ * free RS entries (in total and per FU type queue), ROB entries and physical registers
+ * @return the top-down category of the stall, DISP_SLOT_USED if it can dispatch
  */
-void schedule_stage()
+disp_slot_t Processor::dispatch_stall(const HwThread& thread, uint64_t rs_free, const uint64_t* queue_free,
+                                      uint64_t rob_free, uint64_t prf_free) const
 {
-    // Update ready bits for all instructions in RS
-    for (size_t i = 0; i < reservation_station.size(); i++) {
-        proc_inst_t& inst = reservation_station[i];
-        
-        // Skip if instruction is already fired (no need to update ready bits)
-        if (inst.fired) {
-            continue;
-        }
-        
-        // Check if src_reg[0] is ready
-        // Using src_producer tracking: an operand is ready when:
-        // 1. No source register (-1)
-        // 2. src_producer[0] == 0 (no dependency at dispatch time, value was ready)
-        // 3. src_producer[0] has broadcast (the specific instruction we're waiting for has broadcast)
-        bool src0_ready = (inst.src_reg[0] == -1) ||
-                         (inst.src_producer[0] == 0) ||
-                         (tags_broadcast.find(inst.src_producer[0]) != tags_broadcast.end());
-        
-        // Check if src_reg[1] is ready
-        // Same logic with src_producer tracking
-        bool src1_ready = (inst.src_reg[1] == -1) ||
-                         (inst.src_producer[1] == 0) ||
-                         (tags_broadcast.find(inst.src_producer[1]) != tags_broadcast.end());
-        
-        // Instruction is ready to fire if both source registers are ready
-        inst.ready_to_fire = src0_ready && src1_ready;
+    if (thread.dispatch_queue.empty()) {
+        return DISP_SLOT_EMPTY;
+    }
+    const proc_inst_t& head = thread.dispatch_queue.front();
+    if (rs_free == 0 ||
+        (rs_distributed && head.fu_type >= 0 && head.fu_type < 3 && queue_free[head.fu_type] == 0)) {
+        return DISP_SLOT_RS_FULL;
     }
+    if (rob_size > 0 && rob_free == 0) {
+        return DISP_SLOT_ROB_FULL;
+    }
+    if (prf_size > 0 && prf_free == 0 && head.dest_reg >= 0 && head.dest_reg < NUM_ARCH_REGS) {
+        return DISP_SLOT_PRF_FULL;
+    }
+    return DISP_SLOT_USED;
 }
 
 /**
- * Execute stage: Fire ready instructions and complete executing instructions
+ * dispatch_stall over all threads: DISP_SLOT_USED if any thread can dispatch, otherwise
+ * the stall of the first thread with instructions waiting (DISP_SLOT_EMPTY if none has)
+ * @stalled Set to the thread the result describes
  */
-void execute_stage()
+disp_slot_t Processor::dispatch_stall_all(uint64_t rs_free, const uint64_t* queue_free, uint64_t rob_free,
+                                          uint64_t prf_free, size_t* stalled) const
 {
-    // According to half-cycle behavior and spec, operations should happen in this order:
-    // 1. Broadcast results from previous cycle's completions (updates ready bits, frees FUs)
-    // 2. Fire instructions (based on updated ready bits)
-    // 3. Complete instructions (decrement cycles, add to result_buses for next cycle)
-    
-    // C. Broadcast Results (First Half Cycle) - MUST happen first
-    // Process up to R instructions from result buses (instructions that completed in previous cycles)
-    // These broadcasts happen "at the beginning of the next cycle" per spec
-    uint64_t broadcasts_this_cycle = 0;
-    
-    // Process from front of deque (lowest tags first, since they're in tag order)
-    while (!result_buses.empty() && broadcasts_this_cycle < R) {
-        ResultBusEntry entry = result_buses.front();
-        uint64_t tag = entry.tag;
-        int32_t dest_reg = entry.dest_reg;
-        
-        // Mark result as broadcast for instruction in RS (if still present)
-        // Note: Instruction may have been retired before result was broadcast
-        for (size_t i = 0; i < reservation_station.size(); i++) {
-            proc_inst_t& inst = reservation_station[i];
-            if (inst.tag == tag && inst.completed && !inst.result_broadcast) {
-                inst.result_broadcast = true;
-                break;
-            }
+    disp_slot_t blocked = DISP_SLOT_EMPTY;
+    *stalled = 0;
+    for (size_t t = 0; t < threads.size(); t++) {
+        disp_slot_t why = dispatch_stall(threads[t], rs_free, queue_free, rob_free, prf_free);
+        if (why == DISP_SLOT_USED) {
+            *stalled = t;
+            return why;
         }
-        
-        // Free the FU now that result is written to result bus
-        // (per spec: "The function unit is freed only when the result is put onto a result bus")
-        // Search all FUs to find the one executing this tag (instruction may have been retired)
-        bool fu_freed = false;
-        
-        // Check type 0 FUs
-        for (size_t i = 0; i < fu_type0.size() && !fu_freed; i++) {
-            if (fu_type0[i].executing_tag == tag && fu_type0[i].busy) {
-                fu_type0[i].busy = false;
-                fu_type0[i].executing_tag = 0;
-                fu_type0[i].cycles_remaining = 0;
-                fu_freed = true;
-            }
+        if (blocked == DISP_SLOT_EMPTY && why != DISP_SLOT_EMPTY) {
+            blocked = why;
+            *stalled = t;
         }
-        
-        // Check type 1 FUs
-        for (size_t i = 0; i < fu_type1.size() && !fu_freed; i++) {
-            if (fu_type1[i].executing_tag == tag && fu_type1[i].busy) {
-                fu_type1[i].busy = false;
-                fu_type1[i].executing_tag = 0;
-                fu_type1[i].cycles_remaining = 0;
-                fu_freed = true;
+    }
+    return blocked;
+}
+
+/**
+ * Free RS entries right now, in total and per FU type queue (unified RS: every queue
+ * reports the total)
+ * @queue_free Filled with the free entries of the queue of each FU type
+ * @return free entries in the whole RS
+ */
+uint64_t Processor::rs_free_slots(uint64_t* queue_free) const
+{
+    uint64_t rs_free = (RS_SIZE > reservation_station.size()) ? RS_SIZE - reservation_station.size() : 0;
+    for (int t = 0; t < 3; t++) {
+        queue_free[t] = rs_distributed ? rs_queue_size[t] - rs_type_count[t] : rs_free;
+    }
+    return rs_free;
+}
+
+/**
+ * Count the cycles in which dispatch stopped on a full structure (the top-down slots are
+ * charged separately, by account_dispatch_slots)
+ * @blocked Why dispatch stopped (see dispatch_stall_all)
+ * @stalled Thread whose head instruction stalled
+ * @cycles Number of cycles with this outcome
+ */
+void Processor::count_dispatch_stall(disp_slot_t blocked, size_t stalled, uint64_t cycles)
+{
+    if (blocked == DISP_SLOT_ROB_FULL) {
+        rob_full_cycles += cycles;
+    } else if (blocked == DISP_SLOT_PRF_FULL) {
+        prf_full_cycles += cycles;
+    } else if (blocked == DISP_SLOT_RS_FULL) {
+        int32_t type = threads[stalled].dispatch_queue.front().fu_type;
+        if (type >= 0 && type < 3) {
+            rs_full_cycles[type] += cycles;
+        }
+    }
+}
+
+/**
+ * Rename stage (PRF only): read the source mappings, then map the destination to a fresh
+ * physical register, remembering the old mapping so retirement can free it. A source
+ * waits for the producer of its physical register (0 = value available), which gives
+ * the same dependences as reg_producer.
+ * @thread Thread the instruction belongs to (its rename map)
+ * @inst Instruction being dispatched (a free register is guaranteed if it has a destination)
+ */
+void Processor::rename(HwThread& thread, proc_inst_t& inst)
+{
+    int32_t* rename_map = thread.rename_map;
+    for (int s = 0; s < 2; s++) {
+        int32_t reg = inst.src_reg[s];
+        inst.src_producer[s] = (reg >= 0 && reg < NUM_ARCH_REGS) ? phys_producer[rename_map[reg]] : 0;
+    }
+    if (inst.dest_reg >= 0 && inst.dest_reg < NUM_ARCH_REGS) {
+        int32_t phys = prf_free_list.alloc();
+        inst.prev_phys_dest = rename_map[inst.dest_reg];
+        inst.phys_dest = phys;
+        rename_map[inst.dest_reg] = phys;
+        phys_producer[phys] = inst.tag;
+        phys_unretired[phys] = 1;
+    }
+}
+
+/**
+ * Charge the F dispatch slots of each of the given cycles (top-down accounting).
+ * Dispatch itself is limited only by free RS / ROB entries and physical registers, so a
+ * catch-up cycle that moves more than F instructions still counts F used slots.
+ * @dispatched Instructions moved into the RS per cycle
+ * @blocked Why dispatch stopped (see dispatch_stall); charged the unused slots
+ * @cycles Number of cycles with this outcome
+ */
+void Processor::account_dispatch_slots(uint64_t dispatched, disp_slot_t blocked, uint64_t cycles)
+{
+    uint64_t used = (dispatched < F) ? dispatched : F;
+    disp_slot_count[DISP_SLOT_USED] += used * cycles;
+    disp_slot_count[blocked] += (F - used) * cycles;
+}
+
+/**
+ * Charge the issue slots (one per FU) of one FU type for each of the given cycles, after
+ * firing. An unused slot goes to the first cause that applies: a ready instruction was left
+ * behind (the FU is busy, or holds a result waiting for a result bus), instructions of the
+ * type are waiting on producers, or there was nothing of the type to issue.
+ * @type FU type
+ * @fired Instructions of this type fired per cycle
+ * @unfired_ready Ready instructions of this type left unfired (RS bitmask)
+ * @cycles Number of cycles with this outcome
+ */
+void Processor::account_issue_slots(int type, uint64_t fired, const uint64_t* unfired_ready, uint64_t cycles)
+{
+    const std::vector<FU>& pool = (type == 0) ? fu_type0 : (type == 1) ? fu_type1 : fu_type2;
+    uint64_t* counts = issue_slot_count[type];
+    counts[ISSUE_SLOT_USED] += fired * cycles;
+    uint64_t unused = pool.size() - fired;
+    if (unused == 0) {
+        return;
+    }
+    
+    bool ready_left = false;
+    bool unfired_left = false;
+    for (size_t w = 0; w < rs_mask_words; w++) {
+        ready_left |= (unfired_ready[w] != 0);
+        unfired_left |= ((rs_type_bits[type][w] & ~rs_fired_bits[w]) != 0);
+    }
+    
+    if (ready_left) {
+        // Every FU of the type is unavailable. Blocking FUs whose result is still queued for
+        // a result bus are CDB-limited, the rest are busy executing (or between issue slots).
+        uint64_t cdb = 0;
+        if (fu_timing[type].interval == 0) {
+            for (size_t i = 0; i < result_buses.size(); i++) {
+                if (result_buses[i].fu_type == type) {
+                    cdb++;
+                }
+            }
+            if (cdb > unused) {
+                cdb = unused;
             }
         }
+        counts[ISSUE_SLOT_CDB] += cdb * cycles;
+        counts[ISSUE_SLOT_FU_BUSY] += (unused - cdb) * cycles;
+    } else if (unfired_left) {
+        counts[ISSUE_SLOT_DEPENDENCY] += unused * cycles;
+    } else {
+        counts[ISSUE_SLOT_EMPTY] += unused * cycles;
+    }
+}
+
+/**
+ * Schedule stage: Update ready bits for instructions in reservation station
+ */
+void Processor::schedule_stage()
+{
+    // An operand is ready when:
+    // 1. No source register (-1) -> src_producer was 0 at dispatch
+    // 2. No dependency at dispatch time (value was ready) -> src_producer was 0 at dispatch
+    // 3. Its producer has broadcast -> execute_stage woke the lane up (zeroed it)
+    // So readiness is a single compare of both producer lanes against 0.
+    // Fired entries also read as ready, but every consumer masks them out with rs_fired_bits.
+    simd_operands_ready(rs_src_producer0.data(), rs_src_producer1.data(),
+                        reservation_station.size(), rs_ready_bits.data());
+}
+
+/**
+ * Execute stage: Fire ready instructions and complete executing instructions
+ */
+void Processor::execute_stage()
+{
+    // According to half-cycle behavior and spec, operations should happen in this order:
+    // 1. Broadcast results from previous cycle's completions (updates ready bits, frees FUs)
+    // 2. Fire instructions (based on updated ready bits)
+    // 3. Complete instructions (decrement cycles, add to result_buses for next cycle)
+    
+    // C. Broadcast Results (First Half Cycle) - MUST happen first
+    // Process up to R instructions from result buses (instructions that completed in previous cycles)
+    // These broadcasts happen "at the beginning of the next cycle" per spec
+    // Process the records granted a bus by arbitrate_result_buses() (the oldest R, at the front)
+    while (!result_buses.empty() && result_buses.front().granted) {
+        const ResultBusEntry& entry = result_buses.front();
+        uint64_t tag = entry.tag;
+        int32_t dest_reg = entry.dest_reg;
         
-        // Check type 2 FUs
-        for (size_t i = 0; i < fu_type2.size() && !fu_freed; i++) {
-            if (fu_type2[i].executing_tag == tag && fu_type2[i].busy) {
-                fu_type2[i].busy = false;
-                fu_type2[i].executing_tag = 0;
-                fu_type2[i].cycles_remaining = 0;
-                fu_freed = true;
-            }
+        // Mark result as broadcast for instruction in RS (if still present)
+        // Note: Instruction may have been retired before result was broadcast
+        size_t rs_size = reservation_station.size();
+        size_t idx = simd_find_tag(rs_tag.data(), rs_size, tag);
+        if (idx < rs_size && mask_test(rs_completed_bits.data(), idx) &&
+            !mask_test(rs_broadcast_bits.data(), idx)) {
+            mask_set(rs_broadcast_bits.data(), idx);
+            reservation_station[idx].result_broadcast = true;
+        }
+        
+        // Wake up every RS operand waiting on this tag
+        simd_wakeup(rs_src_producer0.data(), rs_src_producer1.data(), rs_size, tag);
+        
+        // Free the FU now that result is written to result bus
+        // (per spec: "The function unit is freed only when the result is put onto a result bus")
+        // The entry remembers which FU holds the result (instruction may have been retired).
+        // Pipelined FUs never hold results, they only limit the issue rate.
+        if (fu_timing[entry.fu_type].interval == 0) {
+            std::vector<FU>& pool = (entry.fu_type == 0) ? fu_type0 : (entry.fu_type == 1) ? fu_type1 : fu_type2;
+            pool[entry.fu_id].busy = false;
+            pool[entry.fu_id].executing_tag = 0;
+        }
+        
+        // The physical register now holds the value (unless it was already freed and reused)
+        if (entry.phys_dest >= 0 && phys_producer[entry.phys_dest] == tag) {
+            phys_producer[entry.phys_dest] = 0;
         }
         
-        // Update register file ready bits ONLY if this instruction is the current producer
-        // This handles proper RAW dependencies: a later instruction reading from this register
-        // should wait for the LATEST write, not any earlier write
+        // Update register file ready bits
+        // Always set ready=true on broadcast; reg_producer only affects NEW dispatches,
+        // existing dependents were woken up above
         if (dest_reg >= 0 && dest_reg < 128) {
-            // Only set ready if this instruction is the current producer
-            // If another instruction is the producer (dispatched later with same dest_reg),
-            // we still set ready=true because that instruction's dependents might already be waiting
-            // and they depend on THIS broadcast (they were dispatched before the later write)
-            // CORRECTION: Always set ready=true on broadcast, but track with reg_producer
-            // The reg_producer only affects NEW dispatches, not existing dependents
-            reg_ready[dest_reg] = true;
+            HwThread& thread = threads[entry.thread];
+            thread.reg_ready[dest_reg] = true;
             // If this instruction was the producer, clear it
-            if (reg_producer[dest_reg] == tag) {
-                reg_producer[dest_reg] = 0;
+            if (thread.reg_producer[dest_reg] == tag) {
+                thread.reg_producer[dest_reg] = 0;
             }
         }
         
-        // Track that this tag has broadcast (for WAW hazard handling)
-        tags_broadcast.insert(tag);
-        
         // Remove from result bus queue
         result_buses.pop_front();
-        broadcasts_this_cycle++;
     }
     
     // B. Fire Instructions (First Half Cycle) - After broadcasts, so ready bits are updated
-    // Collect ready instructions that haven't been fired yet
-    std::vector<std::pair<uint64_t, size_t>> ready_instructions;  // (tag, index in RS)
-    
-    for (size_t i = 0; i < reservation_station.size(); i++) {
-        proc_inst_t& inst = reservation_station[i];
-        if (inst.ready_to_fire && !inst.fired) {
-            ready_instructions.push_back({inst.tag, i});
-        }
-    }
-    
-    // Sort ready instructions by tag (lowest tag first)
-    std::sort(ready_instructions.begin(), ready_instructions.end());
-    
-    // For each ready instruction (in tag order)
-    for (auto& pair : ready_instructions) {
-        size_t idx = pair.second;
-        proc_inst_t& inst = reservation_station[idx];
-        
-        // Find an available FU of the appropriate type
-        FU* allocated_fu = nullptr;
-        int fu_id = -1;
+    // RS index order is tag order, so for each FU type the instructions to fire are simply the
+    // lowest set bits of (ready & type & ~fired): the n-th free FU (lowest id first) takes the
+    // n-th lowest candidate. FU types never compete, so handling them one at a time matches
+    // walking a tag-sorted ready list.
+    std::vector<FU>* fu_pools[3] = { &fu_type0, &fu_type1, &fu_type2 };
+    for (int t = 0; t < 3; t++) {
+        std::vector<FU>& pool = *fu_pools[t];
+        uint64_t* candidates = rs_scratch_bits.data();
+        simd_mask_select(rs_ready_bits.data(), rs_type_bits[t].data(), rs_zero_bits.data(),
+                         rs_fired_bits.data(), rs_mask_words, candidates);
         
-        if (inst.fu_type == 0) {
-            // Look for available type 0 FU
-            for (size_t i = 0; i < fu_type0.size(); i++) {
-                if (!fu_type0[i].busy) {
-                    allocated_fu = &fu_type0[i];
-                    fu_id = i;
-                    break;
-                }
+        size_t w = 0;
+        uint64_t fired = 0;
+        for (size_t fu_id = 0; fu_id < pool.size(); fu_id++) {
+            if (!fu_available(t, pool[fu_id])) {
+                continue;
             }
-        } else if (inst.fu_type == 1) {
-            // Look for available type 1 FU
-            for (size_t i = 0; i < fu_type1.size(); i++) {
-                if (!fu_type1[i].busy) {
-                    allocated_fu = &fu_type1[i];
-                    fu_id = i;
-                    break;
-                }
+            
+            // Next lowest candidate (prefix of the mask)
+            while (w < rs_mask_words && candidates[w] == 0) {
+                w++;
             }
-        } else if (inst.fu_type == 2) {
-            // Look for available type 2 FU
-            for (size_t i = 0; i < fu_type2.size(); i++) {
-                if (!fu_type2[i].busy) {
-                    allocated_fu = &fu_type2[i];
-                    fu_id = i;
-                    break;
-                }
+            if (w == rs_mask_words) {
+                break;  // No more ready instructions of this type
             }
-        }
-        
-        // If FU is available, allocate it and fire the instruction
-        if (allocated_fu != nullptr) {
-            // Allocate FU
-            allocated_fu->busy = true;
-            allocated_fu->executing_tag = inst.tag;
-            allocated_fu->cycles_remaining = 1;  // Latency = 1 cycle
+            size_t idx = w * 64 + __builtin_ctzll(candidates[w]);
+            candidates[w] &= candidates[w] - 1;
+            
+            proc_inst_t& inst = reservation_station[idx];
+            
+            // Allocate FU: a blocking FU is held until the result is broadcast, a pipelined
+            // one only until its next issue slot
+            if (fu_timing[t].interval == 0) {
+                pool[fu_id].busy = true;
+                pool[fu_id].executing_tag = inst.tag;
+            } else {
+                pool[fu_id].next_issue_cycle = current_cycle + fu_timing[t].interval;
+            }
+            
+            // Book the completion on the calendar
+            uint64_t done_cycle = current_cycle + fu_timing[t].latency - 1;
+            if (done_cycle - current_cycle <= wheel_mask) {
+                completion_wheel[done_cycle & wheel_mask].push_back(inst.tag);
+                mask_set(wheel_occupied.data(), done_cycle & wheel_mask);
+            } else {
+                far_completions.push(far_completion_t(done_cycle, inst.tag));
+            }
+            in_flight++;
+            last_progress_cycle = current_cycle;
             
             // Update instruction
+            mask_set(rs_fired_bits.data(), idx);
+            inst.ready_to_fire = true;
             inst.fired = true;
             inst.execute_cycle = current_cycle;
             inst.fu_id = fu_id;
             
             // Update statistics
             inst_fired_this_cycle++;
+            fired++;
         }
+        
+        // Top-down: candidates now holds the ready instructions left unfired
+        account_issue_slots(t, fired, candidates, 1);
     }
     
     // A. Complete Instructions (First Half Cycle) - After broadcasts and firing
-    // Collect completed instruction entries (tag and dest_reg) to add in tag order for next cycle's broadcast
-    std::vector<ResultBusEntry> completed_entries;
+    // The calendar slot for this cycle holds exactly the instructions finishing now.
+    // They are completed in RS (= tag) order, so entries go onto the completion queue
+    // already in (completed_cycle, tag) order.
+    // They will be broadcast at the beginning of the next cycle.
+    // Note: result_buses can hold more than R entries - we broadcast up to R per cycle
+    std::vector<uint64_t>& finishing = completion_wheel[current_cycle & wheel_mask];
+    while (!far_completions.empty() && far_completions.top().first <= current_cycle) {
+        finishing.push_back(far_completions.top().second);
+        far_completions.pop();
+    }
+    if (finishing.empty()) {
+        return;
+    }
+    uint64_t* completing = rs_scratch_bits.data();
+    std::fill(completing, completing + rs_mask_words, 0);
+    for (uint64_t tag : finishing) {
+        // RS is tag ordered and an instruction cannot retire before completing
+        size_t idx = std::lower_bound(rs_tag.begin(), rs_tag.end(), tag) - rs_tag.begin();
+        mask_set(completing, idx);
+    }
+    in_flight -= finishing.size();
+    finishing.clear();
+    mask_clear(wheel_occupied.data(), current_cycle & wheel_mask);
+    last_progress_cycle = current_cycle;
     
-    // For each instruction in RS that has fired = true
-    // Also check instructions that are completed but waiting for result buses (FU still busy)
-    for (size_t i = 0; i < reservation_station.size(); i++) {
-        proc_inst_t& inst = reservation_station[i];
-        
-        if (!inst.fired) {
-            continue;  // Skip if not fired
-        }
-        
-        // Skip if already completed (result should already be on result_buses or broadcast)
-        if (inst.completed) {
-            continue;
-        }
-        
-        // Get the FU this instruction is using
-        FU* fu = nullptr;
-        if (inst.fu_type == 0 && inst.fu_id >= 0 && inst.fu_id < (int)fu_type0.size()) {
-            fu = &fu_type0[inst.fu_id];
-        } else if (inst.fu_type == 1 && inst.fu_id >= 0 && inst.fu_id < (int)fu_type1.size()) {
-            fu = &fu_type1[inst.fu_id];
-        } else if (inst.fu_type == 2 && inst.fu_id >= 0 && inst.fu_id < (int)fu_type2.size()) {
-            fu = &fu_type2[inst.fu_id];
-        }
-        
-        if (fu == nullptr) {
-            continue;  // Invalid FU reference
+    for (size_t w = 0; w < rs_mask_words; w++) {
+        while (completing[w] != 0) {
+            size_t idx = w * 64 + __builtin_ctzll(completing[w]);
+            completing[w] &= completing[w] - 1;
+            
+            proc_inst_t& inst = reservation_station[idx];
+            
+            // Mark as completed
+            mask_set(rs_completed_bits.data(), idx);
+            inst.completed = true;
+            inst.completed_cycle = current_cycle;
+            
+            // Capture dest_reg and FU NOW before instruction might be retired
+            ResultBusEntry entry;
+            entry.tag = inst.tag;
+            entry.dest_reg = inst.dest_reg;
+            entry.completed_cycle = inst.completed_cycle;
+            entry.fu_type = inst.fu_type;
+            entry.fu_id = inst.fu_id;
+            entry.phys_dest = inst.phys_dest;
+            entry.thread = inst.thread;
+            entry.granted = false;
+            result_buses.push_back(entry);
+            
+            // DO NOT free the FU here - it must remain busy until result is written to result bus
+            // (per spec: "The function unit is freed only when the result is put onto a result bus")
+            // The FU will be freed in the broadcast section when the result is actually written to the bus
         }
+    }
+}
+
+/**
+ * @return true if an FU of the given type can accept an instruction this cycle
+ */
+bool Processor::fu_available(int type, const FU& fu) const
+{
+    if (fu_timing[type].interval == 0) {
+        return !fu.busy;
+    }
+    return current_cycle >= fu.next_issue_cycle;
+}
+
+/**
+ * Result-bus arbitration, done once at the start of each cycle: the oldest R waiting results
+ * (the front of the (completed_cycle, tag) ordered queue) win a bus. Winners are marked on
+ * the queue record itself and on their RS entry, so execute_stage broadcasts exactly the
+ * granted records and state_update_stage checks eligibility with a single bit.
+ */
+void Processor::arbitrate_result_buses()
+{
+    if (result_buses.size() > R) {
+        bus_full_cycles++;
+    }
+    uint64_t granted = (result_buses.size() < R) ? result_buses.size() : R;
+    bus_broadcasts += granted;
+    pipeline_trace.result_buses(current_cycle, granted, result_buses.size() - granted);
+    for (size_t i = 0; i < result_buses.size() && i < R; i++) {
+        ResultBusEntry& entry = result_buses[i];
+        entry.granted = true;
         
-        // Verify that this FU is still executing this instruction
-        // (It might have been freed and reused by another instruction)
-        if (fu->executing_tag != inst.tag) {
-            // FU is executing a different instruction (or was freed)
-            // If the FU is not busy, it means the instruction already completed
-            // Mark it as completed if it hasn't been already
-            if (!fu->busy && !inst.completed) {
-                inst.completed = true;
-                inst.completed_cycle = current_cycle;
-                
-                // Capture dest_reg NOW before instruction might be retired
-                ResultBusEntry entry;
-                entry.tag = inst.tag;
-                entry.dest_reg = inst.dest_reg;
-                completed_entries.push_back(entry);
-            }
-            continue;
+        // RS is tag ordered; the entry may already have left the RS
+        std::vector<uint64_t>::iterator it = std::lower_bound(rs_tag.begin(), rs_tag.end(), entry.tag);
+        if (it != rs_tag.end() && *it == entry.tag) {
+            mask_set(rs_granted_bits.data(), it - rs_tag.begin());
         }
-        
-        // With latency=1, instruction completes in the SAME cycle it fires
-        // Mark as completed immediately
-        inst.completed = true;
-        inst.completed_cycle = current_cycle;
-        
-        // Capture dest_reg NOW before instruction might be retired
-        ResultBusEntry entry;
-        entry.tag = inst.tag;
-        entry.dest_reg = inst.dest_reg;
-        completed_entries.push_back(entry);
-        
-        // DO NOT free the FU here - it must remain busy until result is written to result bus
-        // (per spec: "The function unit is freed only when the result is put onto a result bus")
-        // The FU will be freed in the broadcast section when the result is actually written to the bus
-    }
-    
-    // Add completed instructions to result bus queue in tag order
-    // These will be broadcast at the beginning of the next cycle
-    // Note: result_buses can grow beyond R - we broadcast up to R per cycle
-    std::sort(completed_entries.begin(), completed_entries.end(), 
-              [](const ResultBusEntry& a, const ResultBusEntry& b) { return a.tag < b.tag; });
-    for (const ResultBusEntry& entry : completed_entries) {
-        result_buses.push_back(entry);
     }
 }
 
 /**
  * State Update stage: Retire completed instructions
  */
-void state_update_stage()
+void Processor::state_update_stage()
 {
-    
     // Find instructions ready to retire
     // Per spec: state update happens in second half of cycle, after result broadcast in first half
     // Since we execute in reverse order (state update before execute), state update runs first.
@@ -603,241 +1328,556 @@ void state_update_stage()
     // make instructions eligible for state update (second half) in the SAME cycle.
     // To achieve this with reverse order, we check for instructions whose results are in result_buses
     // (about to be broadcast in this cycle's execute_stage), OR whose results were already broadcast.
-    std::vector<std::tuple<uint64_t, uint64_t, size_t>> ready_to_retire;  
-    // (completed_cycle, tag, index in RS)
+    // arbitrate_result_buses() already marked the former in rs_granted_bits.
+    //
+    // Instruction is eligible for state update if it completed and:
+    // 1. Result was already broadcast (result_broadcast = true), OR
+    // 2. Result won a result bus this cycle (granted, broadcast in this cycle's execute_stage)
+    // This allows state update (second half) to retire instructions whose results
+    // were broadcast in execute_stage (first half) of the same cycle
+    uint64_t* candidates = rs_scratch_bits.data();
+    simd_mask_select(rs_completed_bits.data(), rs_broadcast_bits.data(), rs_granted_bits.data(),
+                     rs_zero_bits.data(), rs_mask_words, candidates);
     
-    // Build set of tags that will ACTUALLY be broadcast this cycle
-    // IMPORTANT: Only the first R entries (sorted by tag) will be broadcast!
-    // The result_buses deque is already in tag order (lowest tags at front)
-    std::set<uint64_t> tags_about_to_broadcast;
-    uint64_t count = 0;
-    for (const auto& entry : result_buses) {
-        if (count >= R) break;  // Only first R will be broadcast
-        tags_about_to_broadcast.insert(entry.tag);
-        count++;
+    // Retire every candidate. They all retire in this cycle and the debug output is
+    // tag-ordered, so walking the mask in RS (= tag) order needs no sort.
+    bool any_retired = false;
+    for (size_t w = 0; w < rs_mask_words; w++) {
+        uint64_t pending = candidates[w];
+        while (pending != 0) {
+            size_t idx = w * 64 + __builtin_ctzll(pending);
+            pending &= pending - 1;
+            proc_inst_t& inst = reservation_station[idx];
+            inst.broadcast_cycle = current_cycle;
+            any_retired = true;
+            
+            // With a ROB the instruction only leaves the RS here; commit_stage retires it
+            if (rob_size > 0) {
+                rob.complete(inst);
+            } else {
+                retire(inst);
+            }
+        }
     }
     
-    for (size_t i = 0; i < reservation_station.size(); i++) {
-        proc_inst_t& inst = reservation_station[i];
-        // Instruction is eligible for state update if:
-        // 1. Result was already broadcast (result_broadcast = true), OR
-        // 2. Result is about to be broadcast this cycle (in result_buses)
-        // This allows state update (second half) to retire instructions whose results
-        // were broadcast in execute_stage (first half) of the same cycle
-        if (inst.completed && !inst.retired && 
-            (inst.result_broadcast || tags_about_to_broadcast.count(inst.tag) > 0)) {
-            ready_to_retire.push_back({inst.completed_cycle, inst.tag, i});
-        }
+    // Remove from RS (in second half cycle); the candidate mask is exactly the set retired
+    if (any_retired) {
+        rs_compact(candidates);
     }
     
-    // Sort by: oldest first (by completed_cycle), then by tag
-    std::sort(ready_to_retire.begin(), ready_to_retire.end());
+    // In-order commit from the ROB, in the same half cycle
+    if (rob_size > 0) {
+        commit_stage();
+    }
+}
+
+/**
+ * Commit stage (ROB only): retire up to commit_width instructions from the ROB head, in
+ * tag order, stopping at the first one whose result has not been broadcast
+ */
+void Processor::commit_stage()
+{
+    uint64_t width = (commit_width > 0) ? commit_width : F;
+    for (uint64_t n = 0; n < width && rob.front_done(); n++) {
+        retire(rob.front());
+        rob.pop_front();
+    }
+}
+
+/**
+ * Retire one instruction in this cycle: log it, count it and free the physical register
+ * its destination used to map to. That register's own producer may still be in the RS
+ * when there is no ROB; it is then freed once that producer retires.
+ * @inst Instruction leaving the RS (no ROB) or the ROB head
+ */
+void Processor::retire(proc_inst_t& inst)
+{
+    // Set retired = true
+    inst.retired = true;
     
-    // Collect indices to remove (in reverse order to avoid index shifting issues)
-    std::vector<size_t> indices_to_remove;
+    // Set state_update_cycle = current_cycle
+    inst.state_update_cycle = current_cycle;
     
-    // For each instruction (in order)
-    for (auto& tuple : ready_to_retire) {
-        size_t idx = std::get<2>(tuple);
-        proc_inst_t& inst = reservation_station[idx];
-        
-        // Set retired = true
-        inst.retired = true;
-        
-        // Set state_update_cycle = current_cycle
-        inst.state_update_cycle = current_cycle;
-        
-        // Store instruction for output
-        retired_instructions.push_back(inst);
-        
-        // Mark for removal from RS
-        indices_to_remove.push_back(idx);
-        
-        // Increment instructions_retired
-        instructions_retired++;
-        inst_retired_this_cycle++;
-    }
+    // Log its timeline (no-ops unless a retire log / pipeline trace is open)
+    retire_log.record(inst);
+    pipeline_trace.record(inst);
     
-    // Remove from RS (in second half cycle)
-    // Remove in reverse order to avoid index shifting issues
-    std::sort(indices_to_remove.rbegin(), indices_to_remove.rend());
-    for (size_t idx : indices_to_remove) {
-        reservation_station.erase(reservation_station.begin() + idx);
+    if (inst.phys_dest >= 0) {
+        phys_unretired[inst.phys_dest] = 0;
+        if (phys_free_pending[inst.phys_dest]) {
+            phys_free_pending[inst.phys_dest] = 0;
+            prf_free_list.release(inst.phys_dest);
+        }
+    }
+    if (inst.prev_phys_dest >= 0) {
+        if (phys_unretired[inst.prev_phys_dest]) {
+            phys_free_pending[inst.prev_phys_dest] = 1;
+        } else {
+            prf_free_list.release(inst.prev_phys_dest);
+        }
     }
+    
+    // Increment instructions_retired
+    last_progress_cycle = current_cycle;
+    threads[inst.thread].retired++;
+    instructions_retired++;
+    inst_retired_this_cycle++;
 }
 
 /**
- * Subroutine that simulates the processor.
- *   The processor should fetch instructions as appropriate, until all instructions have executed
- * XXX: You're responsible for completing this routine
- *
- * @p_stats Pointer to the statistics structure
+ * Simulate one cycle: all five stages in reverse order, then the per-cycle statistics
  */
-void run_proc(proc_stats_t* p_stats)
+void Processor::cycle()
 {
-    // Initialize per-cycle statistics
-    inst_fired_this_cycle = 0;
-    inst_retired_this_cycle = 0;
-    total_inst_fired = 0;
-    total_disp_size_sum = 0;
+    current_cycle++;
     
-    // Main simulation loop
-    while (!all_instructions_retired()) {
-        current_cycle++;
-        
-        // Safety check: prevent infinite loops
-        if (current_cycle > 1000000) {
-            fprintf(stderr, "ERROR: Simulation exceeded 1M cycles. Possible infinite loop!\n");
-            fprintf(stderr, "  trace_done: %d\n", trace_done);
-            fprintf(stderr, "  dispatch_queue.size(): %zu\n", dispatch_queue.size());
-            fprintf(stderr, "  reservation_station.size(): %zu\n", reservation_station.size());
-            fprintf(stderr, "  result_buses.size(): %zu\n", result_buses.size());
-            fprintf(stderr, "  instructions_fetched: %lu\n", instructions_fetched);
-            fprintf(stderr, "  instructions_retired: %lu\n", instructions_retired);
-            
-            // Debug: Check RS state
-            uint64_t fired_count = 0, completed_count = 0, ready_count = 0;
-            for (size_t i = 0; i < reservation_station.size(); i++) {
-                if (reservation_station[i].fired) fired_count++;
-                if (reservation_station[i].completed) completed_count++;
-                if (reservation_station[i].ready_to_fire) ready_count++;
+    // Capture RS slots available at START of cycle (before state_update frees slots)
+    // Per spec: "reservation station is freed in the second half cycle, so if RS is currently 
+    // full and two instructions are in the state update, you can't put new instructions in the RS"
+    rs_slots_available_this_cycle = rs_free_slots(rs_queue_available_this_cycle);
+    rob_slots_available_this_cycle = rob_size - rob.size();  // Same for the ROB (commit frees late)
+    prf_available_this_cycle = prf_free_list.free_count;     // And for physical registers (retire frees late)
+    
+    // Execute stages in REVERSE ORDER (as per spec)
+    // Note: Even though we call stages in reverse order, the half-cycle behavior means
+    // that within a cycle, first half events (broadcast in execute) happen before
+    // second half events (retire in state update). We achieve this by having execute_stage
+    // broadcast results from the previous cycle, which state_update can then retire.
+    // 0. Grant result buses for this cycle's broadcasts
+    arbitrate_result_buses();
+    
+    // 1. State Update (second half: retire instructions whose results were broadcast)
+    state_update_stage();
+    
+    // 2. Execute (first half: completion, firing, and result broadcast)
+    execute_stage();
+    
+    // 3. Schedule (move from dispatch to RS)
+    schedule_stage();
+    
+    // 4. Dispatch (move from fetch to dispatch)
+    dispatch_stage();
+    
+    // 5. Fetch (read new instructions)
+    fetch_stage();
+    
+    // Update statistics
+    update_stats();
+}
+
+/**
+ * Advance the simulation by up to the given number of cycles (stops early once done(),
+ * i.e. every instruction has retired or the pipeline is stuck).
+ * @cycles Maximum number of cycles to simulate
+ * @return Number of cycles actually simulated
+ */
+uint64_t Processor::step(uint64_t cycles)
+{
+    uint64_t n = 0;
+    while (n < cycles && !done()) {
+        // Jump over cycles in which nothing can happen, but never past the requested span
+        uint64_t idle = idle_skip ? idle_cycles_ahead() : 0;
+        if (idle > 0) {
+            if (idle > cycles - n) {
+                idle = cycles - n;
             }
-            fprintf(stderr, "  RS: fired=%lu, completed=%lu, ready=%lu\n", fired_count, completed_count, ready_count);
-            
-            // Debug: Check FU state
-            uint64_t busy_fu0 = 0, busy_fu1 = 0, busy_fu2 = 0;
-            for (size_t i = 0; i < fu_type0.size(); i++) if (fu_type0[i].busy) busy_fu0++;
-            for (size_t i = 0; i < fu_type1.size(); i++) if (fu_type1[i].busy) busy_fu1++;
-            for (size_t i = 0; i < fu_type2.size(); i++) if (fu_type2[i].busy) busy_fu2++;
-            fprintf(stderr, "  FUs busy: k0=%lu/%lu, k1=%lu/%lu, k2=%lu/%lu\n", 
-                    busy_fu0, fu_type0.size(), busy_fu1, fu_type1.size(), busy_fu2, fu_type2.size());
-            
-            // Debug: Check first few instructions in RS
-            fprintf(stderr, "  First 5 instructions in RS:\n");
-            for (size_t i = 0; i < reservation_station.size() && i < 5; i++) {
-                proc_inst_t& inst = reservation_station[i];
-                fprintf(stderr, "    tag=%lu: fired=%d, completed=%d, ready=%d, src_reg=[%d,%d], dest_reg=%d\n",
-                        inst.tag, inst.fired, inst.completed, inst.ready_to_fire,
-                        inst.src_reg[0], inst.src_reg[1], inst.dest_reg);
-                if (inst.src_reg[0] >= 0 && inst.src_reg[0] < 128) {
-                    fprintf(stderr, "      src_reg[0]=%d ready=%d\n", inst.src_reg[0], reg_ready[inst.src_reg[0]]);
-                }
-                if (inst.src_reg[1] >= 0 && inst.src_reg[1] < 128) {
-                    fprintf(stderr, "      src_reg[1]=%d ready=%d\n", inst.src_reg[1], reg_ready[inst.src_reg[1]]);
-                }
+            skip_cycles(idle);
+            n += idle;
+            continue;
+        }
+        cycle();
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @return the earliest cycle with a booked completion (UINT64_MAX if none). Every wheel
+ *         entry completes within a turn after the current cycle, so the first occupied slot
+ *         after the current one (searched a bitmap word at a time, wrapping around) is the
+ *         wheel's earliest; the heap top is the earliest far completion.
+ */
+uint64_t Processor::next_completion_cycle() const
+{
+    uint64_t event = far_completions.empty() ? UINT64_MAX : far_completions.top().first;
+    size_t words = wheel_occupied.size();
+    uint64_t start = (current_cycle + 1) & wheel_mask;
+    size_t w = start >> 6;
+    uint64_t bits = wheel_occupied[w] & (~(uint64_t)0 << (start & 63));
+    for (size_t n = 0; n <= words; n++) {
+        if (bits != 0) {
+            uint64_t slot = w * 64 + __builtin_ctzll(bits);
+            uint64_t cycle = current_cycle + 1 + ((slot - start) & wheel_mask);
+            return std::min(cycle, event);
+        }
+        w = (w + 1) % words;
+        bits = wheel_occupied[w];
+        if (n + 1 == words) {
+            bits &= ~(~(uint64_t)0 << (start & 63));   // Back at the start word: slots before start
+        }
+    }
+    return event;
+}
+
+/**
+ * Event horizon: how many of the upcoming cycles are guaranteed to change nothing but the
+ * cycle counter and the per-cycle statistics. A cycle is idle when no stage can act:
+ *   - fetch: every thread's trace is done, or its dispatch queue is full
+ *   - dispatch: the dispatch queue is empty, or the RS / ROB / PRF is full and nothing can leave it
+ *   - commit: the ROB head has not broadcast its result
+ *   - result buses: nothing is waiting to broadcast, so nothing can retire or wake up
+ *   - schedule: no RS entry would latch a new ready bit
+ *   - execute: no ready instruction has a free FU of its type, nothing finishes this cycle
+ * Once idle, the pipeline stays idle until the earliest executing instruction completes
+ * (or a pipelined FU can take a waiting instruction). The jump also stops at the next
+ * interval telemetry sample.
+ * @return number of idle cycles ahead (0 if the next cycle may change state, or if the
+ *         pipeline is stuck with no future event, so run() can still report it)
+ */
+uint64_t Processor::idle_cycles_ahead()
+{
+    for (const HwThread& thread : threads) {
+        if (!fetch_blocked(thread)) {
+            return 0;
+        }
+    }
+    if (!result_buses.empty()) {
+        return 0;
+    }
+    uint64_t queue_free[3];
+    uint64_t rs_free = rs_free_slots(queue_free);
+    size_t stalled;
+    if (dispatch_stall_all(rs_free, queue_free, rob_size - rob.size(), prf_free_list.free_count,
+                           &stalled) == DISP_SLOT_USED) {
+        return 0;
+    }
+    if (rob.front_done()) {
+        return 0;  // The ROB head commits next cycle
+    }
+    
+    // RS: nothing may become ready, and nothing completed may be waiting to retire
+    uint64_t* would_be_ready = rs_scratch_bits.data();
+    simd_operands_ready(rs_src_producer0.data(), rs_src_producer1.data(),
+                        reservation_station.size(), would_be_ready);
+    for (size_t w = 0; w < rs_mask_words; w++) {
+        if ((would_be_ready[w] & ~rs_ready_bits[w] & ~rs_fired_bits[w]) != 0 ||
+            rs_completed_bits[w] != 0) {
+            return 0;
+        }
+    }
+    
+    // Execute: the next event is the earliest completion on the calendar, or a pipelined FU
+    // reaching its next issue slot while a ready instruction of its type waits. A ready
+    // instruction with a free FU right now means the next cycle is not idle.
+    uint64_t next_cycle = current_cycle + 1;
+    uint64_t event = UINT64_MAX;    // Earliest cycle in which something can happen
+    if (in_flight > 0) {
+        event = next_completion_cycle();
+    }
+    std::vector<FU>* fu_pools[3] = { &fu_type0, &fu_type1, &fu_type2 };
+    for (int t = 0; t < 3; t++) {
+        bool has_candidate = false;
+        for (size_t w = 0; w < rs_mask_words; w++) {
+            if ((rs_ready_bits[w] & rs_type_bits[t][w] & ~rs_fired_bits[w]) != 0) {
+                has_candidate = true;
+                break;
             }
-            
-            // Debug: Check what should have written to these registers
-            fprintf(stderr, "  Checking registers 17, 18, 19:\n");
-            fprintf(stderr, "    reg_ready[17]=%d, reg_ready[18]=%d, reg_ready[19]=%d\n", 
-                    reg_ready[17], reg_ready[18], reg_ready[19]);
-            
-            // Check if there are any completed instructions in RS that should have written to these
-            for (size_t i = 0; i < reservation_station.size(); i++) {
-                proc_inst_t& inst = reservation_station[i];
-                if (inst.completed && (inst.dest_reg == 17 || inst.dest_reg == 18 || inst.dest_reg == 19)) {
-                    fprintf(stderr, "    Found completed instruction tag=%lu writing to reg=%d\n", 
-                            inst.tag, inst.dest_reg);
+        }
+        if (!has_candidate) {
+            continue;
+        }
+        for (size_t i = 0; i < fu_pools[t]->size(); i++) {
+            const FU& fu = (*fu_pools[t])[i];
+            if (fu_timing[t].interval == 0) {
+                if (!fu.busy) {
+                    return 0;
                 }
+            } else if (fu.next_issue_cycle < event) {
+                event = fu.next_issue_cycle;
             }
-            
-            // Debug: Check what the first few instructions that retired wrote to
-            fprintf(stderr, "  First 15 instructions that should have retired (tags 1-15):\n");
-            fprintf(stderr, "    (Note: Only 11 retired, so some may still be in RS or dispatch)\n");
-            exit(1);
         }
-        
-        // Capture RS slots available at START of cycle (before state_update frees slots)
-        // Per spec: "reservation station is freed in the second half cycle, so if RS is currently 
-        // full and two instructions are in the state update, you can't put new instructions in the RS"
-        rs_slots_available_this_cycle = (RS_SIZE > reservation_station.size()) ? 
-                                        (RS_SIZE - reservation_station.size()) : 0;
-        
-        // Execute stages in REVERSE ORDER (as per spec)
-        // Note: Even though we call stages in reverse order, the half-cycle behavior means
-        // that within a cycle, first half events (broadcast in execute) happen before
-        // second half events (retire in state update). We achieve this by having execute_stage
-        // broadcast results from the previous cycle, which state_update can then retire.
-        // 1. State Update (second half: retire instructions whose results were broadcast)
-        state_update_stage();
-        
-        // 2. Execute (first half: completion, firing, and result broadcast)
-        execute_stage();
-        
-        // 3. Schedule (move from dispatch to RS)
-        schedule_stage();
-        
-        // 4. Dispatch (move from fetch to dispatch)
-        dispatch_stage();
-        
-        // 5. Fetch (read new instructions)
-        fetch_stage();
-        
-        // Update statistics
-        update_stats(p_stats);
     }
     
-    // Set final cycle count
-    p_stats->cycle_count = current_cycle;
+    // No future event at all means the pipeline is stuck: simulate normally instead
+    if (event == UINT64_MAX || event <= next_cycle) {
+        return 0;
+    }
+    
+    // A telemetry sample point also ends the jump (its row needs the state at that cycle)
+    uint64_t idle = event - next_cycle;
+    if (interval_log.enabled() && idle > interval_log.next_sample() - current_cycle) {
+        idle = interval_log.next_sample() - current_cycle;
+    }
+    return idle;
 }
 
 /**
- * Print debug output in the format matching .output files
- * Format: INST FETCH DISP SCHED EXEC STATE (tab-separated)
+ * Advance over idle cycles (see idle_cycles_ahead), updating the per-cycle statistics
+ * analytically: nothing fires or retires, the dispatch queue keeps its size and every slot
+ * is charged to the same top-down category. Before the end of a thread's trace an idle
+ * cycle is one in which its fetch is stalled on a full queue.
+ * @cycles Number of idle cycles to skip
  */
-void print_debug_output()
+void Processor::skip_cycles(uint64_t cycles)
 {
-    // Print header
-    printf("INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\n");
+    current_cycle += cycles;
+    total_disp_size_sum += dispatch_queue_size() * cycles;
+    cycles_skipped += cycles;
+    bool queue_full = false;
+    bool fetching = false;       // A thread's trace is not done (so its queue is full)
+    for (const HwThread& thread : threads) {
+        queue_full |= (dispatch_capacity != 0 && thread.dispatch_queue.size() >= dispatch_capacity);
+        fetching |= !thread.trace_done;
+    }
+    if (queue_full) {
+        disp_full_cycles += cycles;
+    }
+    if (fetching) {
+        fetch_stall_cycles += cycles;
+    }
     
-    // Sort retired instructions by tag
-    std::sort(retired_instructions.begin(), retired_instructions.end(),
-              [](const proc_inst_t& a, const proc_inst_t& b) { return a.tag < b.tag; });
+    total_rs_size_sum += reservation_station.size() * cycles;
+    
+    // Top-down: nothing dispatches or fires, and no result waits for a bus
+    uint64_t queue_free[3];
+    uint64_t rs_free = rs_free_slots(queue_free);
+    size_t stalled;
+    disp_slot_t blocked = dispatch_stall_all(rs_free, queue_free, rob_size - rob.size(),
+                                             prf_free_list.free_count, &stalled);
+    count_dispatch_stall(blocked, stalled, cycles);
+    account_dispatch_slots(0, blocked, cycles);
+    for (int t = 0; t < 3; t++) {
+        uint64_t* unfired_ready = rs_scratch_bits.data();
+        simd_mask_select(rs_ready_bits.data(), rs_type_bits[t].data(), rs_zero_bits.data(),
+                         rs_fired_bits.data(), rs_mask_words, unfired_ready);
+        account_issue_slots(t, 0, unfired_ready, cycles);
+    }
     
-    // Print each instruction's stage entry cycles
-    for (const proc_inst_t& inst : retired_instructions) {
-        printf("%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
-               inst.tag,
-               inst.fetch_cycle,
-               inst.dispatch_cycle,
-               inst.schedule_cycle,
-               inst.execute_cycle,
-               inst.state_update_cycle);
+    // idle_cycles_ahead never skips past a sample point, so at most one lands here
+    if (interval_log.enabled() && current_cycle == interval_log.next_sample()) {
+        interval_log.sample(interval_totals());
     }
-    printf("\n");
 }
 
 /**
- * Subroutine for cleaning up any outstanding instructions and calculating overall statistics
- * such as average IPC, average fire rate etc.
+ * @return the running totals the interval time series is computed from
+ */
+interval_totals_t Processor::interval_totals() const
+{
+    interval_totals_t totals;
+    totals.cycle = current_cycle;
+    totals.retired = instructions_retired;
+    totals.fired = total_inst_fired;
+    totals.disp_size_sum = total_disp_size_sum;
+    totals.rs_size_sum = total_rs_size_sum;
+    totals.bus_broadcasts = bus_broadcasts;
+    return totals;
+}
+
+/**
+ * Enable or disable idle-cycle skipping (on by default; results are identical either way)
+ */
+void Processor::set_idle_skip(bool enable)
+{
+    idle_skip = enable;
+}
+
+/**
+ * @return true once the trace is exhausted and every instruction has retired, or once the
+ *         pipeline is stuck (see stuck())
+ */
+bool Processor::done()
+{
+    return all_instructions_retired() || stuck();
+}
+
+/**
+ * Whether a ready instruction waits for the next issue slot of a pipelined FU; it fires
+ * once the slot comes around, however long the issue interval
+ */
+bool Processor::issue_pending() const
+{
+    for (int t = 0; t < 3; t++) {
+        if (fu_timing[t].interval == 0) {
+            continue;
+        }
+        for (size_t w = 0; w < rs_mask_words; w++) {
+            if ((rs_ready_bits[w] & rs_type_bits[t][w] & ~rs_fired_bits[w]) != 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @return true if the pipeline can no longer make progress: nothing has fired, completed
+ *         or retired for RUNAWAY_CYCLES, and no completion or issue is still due (a long
+ *         latency or issue interval alone is not a stall)
+ */
+bool Processor::stuck() const
+{
+    return current_cycle - last_progress_cycle >= RUNAWAY_CYCLES && in_flight == 0 &&
+           !issue_pending();
+}
+
+/**
+ * Print the pipeline state, e.g. once stuck() reports a run that stopped making progress
+ * (likely a simulator bug)
+ * @out Stream to write to
+ */
+void Processor::dump_state(FILE* out) const
+{
+    fprintf(out, "  cycle: %lu\n", current_cycle);
+    for (size_t t = 0; t < threads.size(); t++) {
+        fprintf(out, "  thread %zu: trace_done: %d, dispatch_queue.size(): %zu\n", t,
+                threads[t].trace_done, threads[t].dispatch_queue.size());
+    }
+    fprintf(out, "  reservation_station.size(): %zu / %lu (per FU type: %lu, %lu, %lu)\n",
+            reservation_station.size(), RS_SIZE, rs_type_count[0], rs_type_count[1], rs_type_count[2]);
+    fprintf(out, "  result_buses.size(): %zu\n", result_buses.size());
+    fprintf(out, "  rob.size(): %zu / %lu\n", rob.size(), rob_size);
+    fprintf(out, "  free physical registers: %zu / %lu\n", prf_free_list.free_count, prf_size);
+    fprintf(out, "  instructions_fetched: %lu\n", instructions_fetched);
+    fprintf(out, "  instructions_retired: %lu\n", instructions_retired);
+
+    // RS state
+    uint64_t fired_count = 0, completed_count = 0, ready_count = 0;
+    for (size_t i = 0; i < reservation_station.size(); i++) {
+        if (reservation_station[i].fired) fired_count++;
+        if (reservation_station[i].completed) completed_count++;
+        if (mask_test(rs_ready_bits.data(), i)) ready_count++;
+    }
+    fprintf(out, "  RS: fired=%lu, completed=%lu, ready=%lu\n", fired_count, completed_count, ready_count);
+
+    // FU state
+    uint64_t busy_fu0 = 0, busy_fu1 = 0, busy_fu2 = 0;
+    for (size_t i = 0; i < fu_type0.size(); i++) if (fu_type0[i].busy) busy_fu0++;
+    for (size_t i = 0; i < fu_type1.size(); i++) if (fu_type1[i].busy) busy_fu1++;
+    for (size_t i = 0; i < fu_type2.size(); i++) if (fu_type2[i].busy) busy_fu2++;
+    fprintf(out, "  FUs busy: k0=%lu/%lu, k1=%lu/%lu, k2=%lu/%lu\n",
+            busy_fu0, fu_type0.size(), busy_fu1, fu_type1.size(), busy_fu2, fu_type2.size());
+
+    // Oldest instructions in the RS
+    fprintf(out, "  First 5 instructions in RS:\n");
+    for (size_t i = 0; i < reservation_station.size() && i < 5; i++) {
+        const proc_inst_t& inst = reservation_station[i];
+        fprintf(out, "    tag=%lu: fired=%d, completed=%d, ready=%d, src_reg=[%d,%d], dest_reg=%d\n",
+                inst.tag, inst.fired, inst.completed, (int)mask_test(rs_ready_bits.data(), i),
+                inst.src_reg[0], inst.src_reg[1], inst.dest_reg);
+        const bool* reg_ready = threads[inst.thread].reg_ready;
+        if (inst.src_reg[0] >= 0 && inst.src_reg[0] < NUM_ARCH_REGS) {
+            fprintf(out, "      src_reg[0]=%d ready=%d\n", inst.src_reg[0], reg_ready[inst.src_reg[0]]);
+        }
+        if (inst.src_reg[1] >= 0 && inst.src_reg[1] < NUM_ARCH_REGS) {
+            fprintf(out, "      src_reg[1]=%d ready=%d\n", inst.src_reg[1], reg_ready[inst.src_reg[1]]);
+        }
+    }
+}
+
+/**
+ * Subroutine that simulates the processor.
+ *   The processor should fetch instructions as appropriate, until all instructions have executed
  * XXX: You're responsible for completing this routine
  *
  * @p_stats Pointer to the statistics structure
+ * @return false if the pipeline got stuck (p_stats then holds the statistics so far)
  */
-void complete_proc(proc_stats_t *p_stats) 
+bool Processor::run(proc_stats_t* p_stats)
 {
-    // Calculate final statistics
-    if (p_stats->cycle_count > 0) {
+    // Main simulation loop
+    while (!all_instructions_retired()) {
+        // Safety check: prevent infinite loops. A long trace may run for any number of
+        // cycles, but a pipeline with nothing left to do and no instruction retiring is stuck.
+        if (stuck()) {
+            get_stats(p_stats);
+            return false;
+        }
+        
+        // Jump straight to the next cycle in which some state can change
+        uint64_t idle = idle_skip ? idle_cycles_ahead() : 0;
+        if (idle > 0) {
+            skip_cycles(idle);
+            continue;
+        }
+        
+        cycle();
+    }
+    
+    // Set final cycle count (and the running maximum dispatch queue size)
+    get_stats(p_stats);
+    return true;
+}
+
+/**
+ * Fill p_stats from the statistics accumulated so far. Can be called at any point,
+ * e.g. between step() calls.
+ * @p_stats Pointer to the statistics structure
+ */
+void Processor::get_stats(proc_stats_t* p_stats) const
+{
+    p_stats->cycle_count = current_cycle;
+    p_stats->max_disp_size = max_disp_size;
+    p_stats->retired_instruction = instructions_retired;
+    p_stats->fetch_stall_cycles = fetch_stall_cycles;
+    p_stats->disp_full_cycles = disp_full_cycles;
+    p_stats->rob_full_cycles = rob_full_cycles;
+    p_stats->prf_full_cycles = prf_full_cycles;
+    for (int t = 0; t < 3; t++) {
+        p_stats->rs_full_cycles[t] = rs_full_cycles[t];
+    }
+    for (int i = 0; i < NUM_DISP_SLOTS; i++) {
+        p_stats->disp_slots[i] = disp_slot_count[i];
+    }
+    for (int t = 0; t < 3; t++) {
+        uint64_t total = 0;
+        for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+            p_stats->issue_slots[t][i] = issue_slot_count[t][i];
+            total += issue_slot_count[t][i];
+        }
+        p_stats->fu_utilization[t] = total > 0 ? (float)issue_slot_count[t][ISSUE_SLOT_USED] / (float)total : 0.0f;
+    }
+    p_stats->num_threads = threads.size();
+    for (size_t t = 0; t < MAX_SMT_THREADS; t++) {
+        p_stats->thread_retired[t] = (t < threads.size()) ? threads[t].retired : 0;
+        p_stats->thread_ipc[t] = (current_cycle > 0) ? (float)p_stats->thread_retired[t] / (float)current_cycle : 0.0f;
+    }
+    p_stats->bus_broadcasts = bus_broadcasts;
+    p_stats->bus_full_cycles = bus_full_cycles;
+    p_stats->bus_utilization = (current_cycle > 0 && R > 0) ?
+                               (float)bus_broadcasts / (float)(R * current_cycle) : 0.0f;
+    
+    if (current_cycle > 0) {
         // Average instructions fired per cycle
-        p_stats->avg_inst_fired = (float)total_inst_fired / (float)p_stats->cycle_count;
+        p_stats->avg_inst_fired = (float)total_inst_fired / (float)current_cycle;
         
         // Average instructions retired per cycle (IPC)
-        p_stats->avg_inst_retired = (float)instructions_retired / (float)p_stats->cycle_count;
+        p_stats->avg_inst_retired = (float)instructions_retired / (float)current_cycle;
         
         // Average dispatch queue size
-        p_stats->avg_disp_size = (float)total_disp_size_sum / (float)p_stats->cycle_count;
+        p_stats->avg_disp_size = (float)total_disp_size_sum / (float)current_cycle;
     } else {
         // Handle edge case where cycle_count is 0
         p_stats->avg_inst_fired = 0.0f;
         p_stats->avg_inst_retired = 0.0f;
         p_stats->avg_disp_size = 0.0f;
     }
+}
+
+/**
+ * Subroutine for cleaning up any outstanding instructions and calculating overall statistics
+ * such as average IPC, average fire rate etc.
+ * XXX: You're responsible for completing this routine
+ *
+ * @p_stats Pointer to the statistics structure
+ */
+void Processor::complete(proc_stats_t *p_stats) 
+{
+    // Calculate final statistics
+    get_stats(p_stats);
     
-    // Set total instructions retired
-    p_stats->retired_instruction = instructions_retired;
-    
-    // Print debug output (instruction stage timing)
-    // print_debug_output();
-    
-    // cycle_count was already set in run_proc()
+    // Flush the instruction timeline log, the last telemetry interval and the trace, if any
+    retire_log.finish();
+    interval_log.finish(interval_totals());
+    pipeline_trace.finish();
 }
@@ -9,6 +9,16 @@
 #define DEFAULT_K2 3
 #define DEFAULT_R 8
 #define DEFAULT_F 4
+#define DEFAULT_FU_LATENCY 1     // Cycles from fire to completion
+#define DEFAULT_FU_INTERVAL 0    // Cycles between issues to one FU; 0 = blocking (busy until broadcast)
+#define DEFAULT_DISPATCH_CAPACITY 0   // Dispatch queue entries; 0 = unbounded
+#define DEFAULT_ROB_SIZE 0            // Reorder buffer entries; 0 = no ROB (retire straight from the RS)
+#define DEFAULT_COMMIT_WIDTH 0        // Instructions committed per cycle with a ROB; 0 = fetch width F
+#define DEFAULT_PRF_SIZE 0            // Physical registers; 0 = implicit renaming (unlimited)
+#define NUM_ARCH_REGS 128             // Architectural registers (src_reg / dest_reg 0-127)
+#define MAX_SMT_THREADS 8             // Hardware threads sharing one back end
+#define RUNAWAY_CYCLES 1000000        // A run is stuck after this many cycles without progress and nothing in flight
+#define MAX_FU_CYCLES 1000000         // Largest FU latency or issue interval accepted by -L, -I and -u
 
 typedef struct _proc_inst_t
 {
@@ -18,15 +28,19 @@ typedef struct _proc_inst_t
     int32_t dest_reg;
     
     // Instruction tracking fields
-    uint64_t tag;                    // Sequential instruction tag (1, 2, 3, ...)
+    uint64_t tag;                    // Sequential instruction tag (1, 2, 3, ...), in dispatch order
+    int32_t thread;                  // Hardware thread (SMT) the instruction belongs to
     uint64_t fetch_cycle;            // Cycle when instruction entered fetch
     uint64_t dispatch_cycle;         // Cycle when instruction entered dispatch
     uint64_t schedule_cycle;         // Cycle when instruction entered schedule/RS
     uint64_t execute_cycle;          // Cycle when instruction started execution
     uint64_t state_update_cycle;     // Cycle when instruction entered state update
     uint64_t completed_cycle;        // Cycle when instruction completed execution
+    uint64_t broadcast_cycle;        // Cycle when the result was broadcast and the RS entry freed
     int32_t fu_type;                 // Function unit type (0, 1, 2, or -1 → use type 1)
     int32_t fu_id;                   // Which specific FU is executing this instruction
+    int32_t phys_dest;               // Physical register renamed to dest_reg (-1 = none / no PRF)
+    int32_t prev_phys_dest;          // Previous mapping of dest_reg, freed when this instruction retires
     bool ready_to_fire;              // Boolean indicating if dependencies are resolved
     bool fired;                       // Boolean indicating if instruction has been fired
     bool completed;                   // Boolean indicating if instruction has completed execution
@@ -37,8 +51,32 @@ typedef struct _proc_inst_t
     // 0 means the value is already available (no pending producer)
     uint64_t src_producer[2];
     
+    // Producer distances from an annotated trace (see trace_dep_record_t), valid only if
+    // has_src_distance; they replace the register lookups at dispatch
+    uint32_t src_distance[2];
+    bool has_src_distance;
+    
 } proc_inst_t;
 
+// Top-down slot accounting: every cycle offers F dispatch slots and one issue slot per FU,
+// and each slot is charged to exactly one category
+enum disp_slot_t {
+    DISP_SLOT_USED,          // An instruction moved from the dispatch queue into the RS
+    DISP_SLOT_RS_FULL,       // Instructions were waiting but the RS had no free entry
+    DISP_SLOT_EMPTY,         // Dispatch queue empty (front end starved or trace done)
+    DISP_SLOT_ROB_FULL,      // Instructions were waiting, the RS had room but the ROB was full
+    DISP_SLOT_PRF_FULL,      // The next instruction needed a physical register and none was free
+    NUM_DISP_SLOTS
+};
+enum issue_slot_t {
+    ISSUE_SLOT_USED,         // An instruction fired on this FU
+    ISSUE_SLOT_FU_BUSY,      // Ready instructions waited, FU still executing / not at its issue slot
+    ISSUE_SLOT_CDB,          // Ready instructions waited, FU held by a result waiting for a result bus
+    ISSUE_SLOT_DEPENDENCY,   // Instructions of this type were in the RS, none had its operands
+    ISSUE_SLOT_EMPTY,        // No unfired instruction of this type in the RS
+    NUM_ISSUE_SLOTS
+};
+
 typedef struct _proc_stats_t
 {
     float avg_inst_retired;
@@ -47,8 +85,39 @@ typedef struct _proc_stats_t
     unsigned long max_disp_size;
     unsigned long retired_instruction;
     unsigned long cycle_count;
+    unsigned long fetch_stall_cycles;   // Cycles fetch stopped short because the dispatch queue was full
+    unsigned long disp_full_cycles;     // Cycles that ended with the dispatch queue at capacity
+    unsigned long rob_full_cycles;      // Cycles in which dispatch stopped because the ROB was full
+    unsigned long prf_full_cycles;      // Cycles in which dispatch stopped for lack of a free physical register
+    unsigned long rs_full_cycles[3];    // Cycles in which dispatch stopped on a full RS, by the head's FU type
+    
+    // Top-down accounting (slot counts by category, see disp_slot_t / issue_slot_t)
+    unsigned long disp_slots[NUM_DISP_SLOTS];
+    unsigned long issue_slots[3][NUM_ISSUE_SLOTS];   // Per FU type
+    float fu_utilization[3];            // Issue slots used / issue slots, per FU type
+    unsigned long bus_broadcasts;       // Result-bus slots used (results broadcast)
+    unsigned long bus_full_cycles;      // Cycles in which a completed result found all R buses taken
+    float bus_utilization;              // Result-bus slots used / (R * cycles)
+    
+    // SMT: per-thread retirement (the fields above are aggregates over all threads)
+    unsigned long num_threads;
+    unsigned long thread_retired[MAX_SMT_THREADS];
+    float thread_ipc[MAX_SMT_THREADS];
 } proc_stats_t;
 
+// SMT fetch policy: which thread fetches in a cycle (one thread fetches up to F instructions)
+enum smt_fetch_policy_t {
+    SMT_FETCH_ROUND_ROBIN,   // Threads take turns
+    SMT_FETCH_ICOUNT         // Thread with the fewest instructions in the dispatch queue and RS
+};
+
+// Per-FU-type timing
+typedef struct _fu_timing_t
+{
+    uint64_t latency;     // Fire at cycle c -> completes at cycle c + latency - 1 (>= 1)
+    uint64_t interval;    // Pipelined issue interval (1 = fully pipelined), 0 = blocking
+} fu_timing_t;
+
 bool read_instruction(proc_inst_t* p_inst);
 
 void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f);
@@ -0,0 +1,235 @@
+#include "procsim_analyze.hpp"
+#include <deque>
+#include <vector>
+
+#define DISTANCE_BUCKETS 21    // Dependence distances 1, 2-3, 4-7, ..., >= 2^20
+
+// Per-cycle usage of one resource with a fixed number of units per cycle. Cycles below
+// base are full or can no longer be requested, so they are dropped.
+struct SlotCalendar {
+    uint64_t capacity;             // Units per cycle, 0 = unlimited
+    uint64_t base;                 // Cycle of used[0]
+    std::deque<uint32_t> used;
+
+    void reset(uint64_t capacity) { this->capacity = capacity; base = 1; used.clear(); }
+
+    uint64_t count(uint64_t cycle) const { return (cycle - base < used.size()) ? used[cycle - base] : 0; }
+
+    // Earliest cycle >= earliest with a free unit for length consecutive cycles; takes it
+    uint64_t reserve(uint64_t earliest, uint64_t length)
+    {
+        if (capacity == 0) {
+            return earliest;
+        }
+        uint64_t c = (earliest > base) ? earliest : base;
+        uint64_t i = 0;
+        while (i < length) {
+            if (count(c + i) >= capacity) {
+                c += i + 1;   // No span can contain this full cycle: restart after it
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+        if (c + length - base > used.size()) {
+            used.resize(c + length - base, 0);
+        }
+        for (uint64_t i = 0; i < length; i++) {
+            used[c + i - base]++;
+        }
+        while (!used.empty() && used.front() >= capacity) {
+            used.pop_front();
+            base++;
+        }
+        return c;
+    }
+
+    // No later request will ask for a cycle below floor
+    void trim(uint64_t floor)
+    {
+        while (base < floor && !used.empty()) {
+            used.pop_front();
+            base++;
+        }
+        if (base < floor) {
+            base = floor;
+        }
+    }
+};
+
+// One machine model of the analysis
+struct DataflowModel {
+    const char* name;
+    bool windowed;
+    SlotCalendar fu[3];
+    SlotCalendar bus;
+    uint64_t reg_ready[128];           // Broadcast cycle of each register's latest producer
+    std::vector<uint64_t> fire_max;    // Ring: latest fire cycle among tags <= tag (slot = tag % window)
+    uint64_t running_fire_max;
+    uint64_t last_cycle;               // Latest broadcast = critical path length
+
+    void reset(const char* name, bool windowed, const uint64_t fu_limit[3], uint64_t bus_limit,
+               uint64_t window)
+    {
+        this->name = name;
+        this->windowed = windowed;
+        for (int t = 0; t < 3; t++) {
+            fu[t].reset(fu_limit[t]);
+        }
+        bus.reset(bus_limit);
+        for (int i = 0; i < 128; i++) {
+            reg_ready[i] = 0;
+        }
+        fire_max.assign(windowed ? window : 0, 0);
+        running_fire_max = 0;
+        last_cycle = 0;
+    }
+
+    void schedule(const proc_inst_t& inst, uint64_t tag, int type, const fu_timing_t timing[3])
+    {
+        // Operands are available in their producer's broadcast cycle
+        uint64_t ready = 1;
+        for (int s = 0; s < 2; s++) {
+            int32_t reg = inst.src_reg[s];
+            if (reg >= 0 && reg < 128 && reg_ready[reg] > ready) {
+                ready = reg_ready[reg];
+            }
+        }
+
+        // Window: wait until every instruction W older has fired
+        if (windowed) {
+            size_t slot = tag % fire_max.size();
+            if (tag > fire_max.size()) {
+                uint64_t floor = fire_max[slot];
+                if (floor > ready) {
+                    ready = floor;
+                }
+                for (int t = 0; t < 3; t++) {
+                    fu[t].trim(floor);
+                }
+                bus.trim(floor);
+            }
+        }
+
+        // A blocking FU is occupied for the whole latency, a pipelined one for its interval
+        uint64_t occupancy = timing[type].interval ? timing[type].interval : timing[type].latency;
+        uint64_t fire = fu[type].reserve(ready, occupancy);
+        uint64_t broadcast = bus.reserve(fire + timing[type].latency, 1);
+
+        if (inst.dest_reg >= 0 && inst.dest_reg < 128) {
+            reg_ready[inst.dest_reg] = broadcast;
+        }
+        if (fire > running_fire_max) {
+            running_fire_max = fire;
+        }
+        if (windowed) {
+            fire_max[tag % fire_max.size()] = running_fire_max;
+        }
+        if (broadcast > last_cycle) {
+            last_cycle = broadcast;
+        }
+    }
+};
+
+void analyze_trace(const analyze_config_t& config, FILE* out)
+{
+    uint64_t window = config.window > 0 ? config.window : 1;
+    const uint64_t none[3] = { 0, 0, 0 };
+    uint64_t only[3][3] = { { config.k[0], 0, 0 }, { 0, config.k[1], 0 }, { 0, 0, config.k[2] } };
+
+    enum { M_DATAFLOW, M_WINDOW, M_K0, M_K1, M_K2, M_FUS, M_BUSES, M_ALL, NUM_MODELS };
+    std::vector<DataflowModel> models(NUM_MODELS);
+    models[M_DATAFLOW].reset("dataflow (unlimited)", false, none, 0, window);
+    models[M_WINDOW].reset("window only", true, none, 0, window);
+    models[M_K0].reset("window + k0 FUs", true, only[0], 0, window);
+    models[M_K1].reset("window + k1 FUs", true, only[1], 0, window);
+    models[M_K2].reset("window + k2 FUs", true, only[2], 0, window);
+    models[M_FUS].reset("window + all FUs", true, config.k, 0, window);
+    models[M_BUSES].reset("window + result buses", true, none, config.r, window);
+    models[M_ALL].reset("window + FUs + buses", true, config.k, config.r, window);
+
+    // Trace statistics: op mix and distance (in tags) from each source operand to its producer
+    uint64_t op_mix[3] = { 0, 0, 0 };
+    uint64_t distance[DISTANCE_BUCKETS] = { 0 };
+    uint64_t operands = 0;             // Register source operands
+    uint64_t reg_producer[128] = { 0 };
+
+    proc_inst_t inst;
+    uint64_t tag = 0;
+    while (read_instruction(&inst)) {
+        tag++;
+        int type = (inst.op_code == -1) ? 1 : inst.op_code;
+        if (type < 0 || type > 2) {
+            type = 1;
+        }
+        op_mix[type]++;
+
+        for (int s = 0; s < 2; s++) {
+            int32_t reg = inst.src_reg[s];
+            if (reg < 0 || reg >= 128) {
+                continue;
+            }
+            operands++;
+            if (reg_producer[reg] != 0) {
+                uint64_t d = tag - reg_producer[reg];
+                int bucket = 63 - __builtin_clzll(d);
+                distance[bucket < DISTANCE_BUCKETS - 1 ? bucket : DISTANCE_BUCKETS - 1]++;
+            }
+        }
+        if (inst.dest_reg >= 0 && inst.dest_reg < 128) {
+            reg_producer[inst.dest_reg] = tag;
+        }
+
+        for (DataflowModel& model : models) {
+            model.schedule(inst, tag, type, config.fu_timing);
+        }
+    }
+
+    fprintf(out, "Dataflow analysis: %lu instructions, window %lu, R=%lu, k0=%lu k1=%lu k2=%lu\n",
+            tag, window, config.r, config.k[0], config.k[1], config.k[2]);
+    if (tag == 0) {
+        return;
+    }
+
+    fprintf(out, "\nOp mix:\n");
+    for (int t = 0; t < 3; t++) {
+        fprintf(out, "  k%d  %10lu  %5.1f%%\n", t, op_mix[t], 100.0 * op_mix[t] / tag);
+    }
+
+    fprintf(out, "\nCritical path:\n");
+    fprintf(out, "  %-24s %12s %10s\n", "model", "cycles", "max IPC");
+    for (const DataflowModel& model : models) {
+        fprintf(out, "  %-24s %12lu %10.3f\n", model.name, model.last_cycle,
+                (double)tag / model.last_cycle);
+    }
+
+    uint64_t with_producer = 0;
+    for (int b = 0; b < DISTANCE_BUCKETS; b++) {
+        with_producer += distance[b];
+    }
+    fprintf(out, "\nDependence distance (%lu register operands, %lu with an in-trace producer):\n",
+            operands, with_producer);
+    for (int b = 0; b < DISTANCE_BUCKETS; b++) {
+        if (distance[b] == 0) {
+            continue;
+        }
+        uint64_t lo = (uint64_t)1 << b;
+        if (b == DISTANCE_BUCKETS - 1) {
+            fprintf(out, "  >= %-14lu %12lu  %5.1f%%\n", lo, distance[b], 100.0 * distance[b] / with_producer);
+        } else {
+            fprintf(out, "  %7lu-%-7lu %12lu  %5.1f%%\n", lo, 2 * lo - 1, distance[b],
+                    100.0 * distance[b] / with_producer);
+        }
+    }
+
+    // A resource can only matter if limiting it alone lowers the windowed ceiling
+    fprintf(out, "\nWorth sweeping (ceiling loss when only this resource is limited):\n");
+    const int limited[] = { M_K0, M_K1, M_K2, M_BUSES };
+    const char* resource[] = { "k0 FUs", "k1 FUs", "k2 FUs", "result buses" };
+    double base = (double)models[M_WINDOW].last_cycle;
+    for (int i = 0; i < 4; i++) {
+        double loss = 1.0 - base / models[limited[i]].last_cycle;
+        fprintf(out, "  %-14s %5.1f%%  %s\n", resource[i], 100.0 * loss,
+                loss >= 0.05 ? "yes" : (loss >= 0.01 ? "marginal" : "no"));
+    }
+}
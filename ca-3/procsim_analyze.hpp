@@ -0,0 +1,36 @@
+#ifndef PROCSIM_ANALYZE_HPP
+#define PROCSIM_ANALYZE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include "procsim.hpp"
+
+// Dataflow-limit analysis: one streaming pass over the trace that schedules every
+// instruction as early as its producers allow (producer tracking as in dispatch_stage,
+// operands available in the broadcast cycle, FU latencies from fu_timing), once per
+// machine model:
+//   - pure dataflow: unlimited everything
+//   - window: instruction i may not fire before every instruction W older has fired
+//   - window plus one resource limit at a time (each FU type, all FUs, result buses)
+// The critical path of each model bounds the cycle count, so comparing the resource-
+// limited ceilings against the window ceiling shows which resources can matter at all.
+// Memory is bounded by the window: slot calendars are trimmed below the oldest cycle
+// any later instruction can still use.
+
+#define DEFAULT_ANALYZE_WINDOW 65536   // Instructions in flight in the windowed models
+#define MAX_ANALYZE_WINDOW (1 << 22)   // Largest -w (each windowed model keeps a ring this size)
+
+typedef struct _analyze_config_t
+{
+    uint64_t r;                // Result buses
+    uint64_t k[3];             // FUs per type
+    fu_timing_t fu_timing[3];
+    uint64_t window;           // Instruction window of the windowed models
+} analyze_config_t;
+
+/**
+ * Read the whole trace through read_instruction() and print the report to out
+ */
+void analyze_trace(const analyze_config_t& config, FILE* out);
+
+#endif /* PROCSIM_ANALYZE_HPP */
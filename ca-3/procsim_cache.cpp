@@ -0,0 +1,224 @@
+#include "procsim_cache.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t trace_content_hash(const trace_dep_record_t* records, size_t count)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < count; i++) {
+        hash = fnv1a_64(&records[i].inst, sizeof(trace_bin_record_t), hash);
+    }
+    return hash;
+}
+
+bool ResultCache::KeyEqual::operator()(const cache_key_t& a, const cache_key_t& b) const
+{
+    return memcmp(&a, &b, sizeof(cache_key_t)) == 0;
+}
+
+// Header this build writes
+static cache_header_t current_header()
+{
+    cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.format = CACHE_FORMAT;
+    header.entry_size = sizeof(cache_entry_t);
+    header.build = fnv1a_64(PROCSIM_BUILD_ID, strlen(PROCSIM_BUILD_ID));
+    return header;
+}
+
+// Read or write exactly size bytes at offset
+static bool read_at(int fd, void* buf, size_t size, off_t offset)
+{
+    char* p = (char*)buf;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, offset);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool write_at(int fd, const void* buf, size_t size, off_t offset)
+{
+    const char* p = (const char*)buf;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+ResultCache::ResultCache() : fd(-1), loaded_end(0)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+ResultCache::~ResultCache()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * Whether the file starts with this build's header (caller holds a lock)
+ */
+bool ResultCache::header_current()
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(cache_header_t)) {
+        return false;
+    }
+    cache_header_t header;
+    cache_header_t expected = current_header();
+    return read_at(fd, &header, sizeof(header), 0) && memcmp(&header, &expected, sizeof(header)) == 0;
+}
+
+/**
+ * Empty the file and write this build's header (caller holds the exclusive lock)
+ */
+bool ResultCache::reset()
+{
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > (off_t)sizeof(cache_header_t)) {
+        counters.discarded += (st.st_size - sizeof(cache_header_t)) / sizeof(cache_entry_t);
+    }
+    cache_header_t header = current_header();
+    loaded_end = sizeof(cache_header_t);
+    return ftruncate(fd, 0) == 0 && write_at(fd, &header, sizeof(header), 0);
+}
+
+/**
+ * Read the complete entries in [from, to) into memory (caller holds a lock); a torn tail
+ * from an interrupted writer is skipped
+ */
+bool ResultCache::load(off_t from, off_t to)
+{
+    uint64_t count = (to - from) / sizeof(cache_entry_t);
+    std::vector<cache_entry_t> loaded(count);
+    if (count > 0 && !read_at(fd, loaded.data(), count * sizeof(cache_entry_t), from)) {
+        return false;
+    }
+    for (size_t i = 0; i < loaded.size(); i++) {
+        entries[loaded[i].key] = loaded[i].stats;
+    }
+    counters.loaded += count;
+    loaded_end = from + count * sizeof(cache_entry_t);
+    return true;
+}
+
+bool ResultCache::open(const char* path)
+{
+    fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // A stale or new file is (re)initialized under the exclusive lock; the header is
+    // checked again there, as another process may have done it in between
+    if (flock(fd, LOCK_SH) != 0) {
+        return false;
+    }
+    bool current = header_current();
+    flock(fd, LOCK_UN);
+    if (!current) {
+        if (flock(fd, LOCK_EX) != 0) {
+            return false;
+        }
+        bool ok = header_current() || reset();
+        flock(fd, LOCK_UN);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (flock(fd, LOCK_SH) != 0) {
+        return false;
+    }
+    bool ok = true;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && header_current()) {
+        ok = load(sizeof(cache_header_t), st.st_size);
+    }
+    flock(fd, LOCK_UN);
+    return ok;
+}
+
+bool ResultCache::lookup(const cache_key_t& key, proc_stats_t* stats)
+{
+    std::unordered_map<cache_key_t, proc_stats_t, KeyHash, KeyEqual>::const_iterator it = entries.find(key);
+    if (it == entries.end()) {
+        counters.misses++;
+        return false;
+    }
+    counters.hits++;
+    *stats = it->second;
+    return true;
+}
+
+void ResultCache::insert(const cache_key_t& key, const proc_stats_t& stats)
+{
+    cache_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.key = key;
+    entry.stats = stats;
+    pending.push_back(entry);
+    entries[key] = stats;
+}
+
+bool ResultCache::flush()
+{
+    if (fd < 0 || pending.empty()) {
+        return fd >= 0;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        return false;
+    }
+
+    // Another build may have taken the file over since open(); the newest writer wins.
+    // Entries other processes appended meanwhile are picked up, so results computed
+    // concurrently are stored once, and a torn tail is cut so the new entries stay aligned.
+    bool ok = header_current() || reset();
+    struct stat st;
+    ok = ok && fstat(fd, &st) == 0;
+    if (ok && loaded_end > st.st_size) {
+        loaded_end = sizeof(cache_header_t);   // Emptied by other builds in between
+    }
+    std::unordered_map<cache_key_t, proc_stats_t, KeyHash, KeyEqual> mine;
+    mine.swap(entries);
+    ok = ok && load(loaded_end, st.st_size);
+    std::vector<cache_entry_t> fresh;
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (entries.find(pending[i].key) == entries.end()) {
+            fresh.push_back(pending[i]);
+        }
+    }
+    for (auto& entry : mine) {
+        entries.insert(entry);
+    }
+    if (ok && !fresh.empty()) {
+        ok = (loaded_end == st.st_size || ftruncate(fd, loaded_end) == 0) &&
+             write_at(fd, fresh.data(), fresh.size() * sizeof(cache_entry_t), loaded_end);
+    }
+    flock(fd, LOCK_UN);
+    if (ok) {
+        counters.stored += fresh.size();
+        loaded_end += fresh.size() * sizeof(cache_entry_t);
+        pending.clear();
+    }
+    return ok;
+}
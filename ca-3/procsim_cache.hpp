@@ -0,0 +1,121 @@
+#ifndef PROCSIM_CACHE_HPP
+#define PROCSIM_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "procsim.hpp"
+#include "procsim_trace.hpp"
+
+// On-disk result cache for sweeps: one file of fixed-size entries, each the full
+// proc_stats_t of one simulation, keyed by a content hash of the trace, the processor
+// settings and (R, k0, k1, k2, F). Concurrent processes share the file through flock():
+// shared while loading, exclusive while appending. The header records the simulator build,
+// and a file written by another build (or with another entry layout) is discarded.
+
+#define CACHE_MAGIC "PRCCACH\n"
+#define CACHE_FORMAT 1
+
+// Build identity; the Makefile passes a checksum of the sources, so any code change
+// invalidates the cache. Builds without it fall back to the compile time.
+#ifndef PROCSIM_BUILD_ID
+#define PROCSIM_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+inline uint64_t fnv1a_64(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+typedef struct _cache_header_t
+{
+    char magic[8];            // CACHE_MAGIC
+    uint32_t format;          // CACHE_FORMAT
+    uint32_t entry_size;      // sizeof(cache_entry_t)
+    uint64_t build;           // fnv1a_64 of PROCSIM_BUILD_ID
+} cache_header_t;
+
+typedef struct _cache_key_t
+{
+    uint64_t trace_hash;      // trace_content_hash()
+    uint64_t trace_length;    // Instructions in the trace
+    uint64_t settings_hash;   // Processor::settings_hash()
+    uint64_t r;
+    uint64_t k0;
+    uint64_t k1;
+    uint64_t k2;
+    uint64_t f;
+} cache_key_t;
+
+typedef struct _cache_entry_t
+{
+    cache_key_t key;
+    proc_stats_t stats;
+} cache_entry_t;
+
+typedef struct _cache_stats_t
+{
+    uint64_t loaded;          // Entries read from the file
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stored;          // Entries appended by this process
+    uint64_t discarded;       // Entries dropped because another build wrote them
+} cache_stats_t;
+
+/**
+ * Content hash of a trace: its instructions in order (the distances follow from them)
+ */
+uint64_t trace_content_hash(const trace_dep_record_t* records, size_t count);
+
+class ResultCache {
+public:
+    ResultCache();
+    ~ResultCache();
+
+    /**
+     * Open (or create) the cache file and load its entries. A file from another build is
+     * emptied first.
+     * @return false if the file cannot be opened, locked or read
+     */
+    bool open(const char* path);
+
+    // Cached statistics of a key (counts a hit or a miss)
+    bool lookup(const cache_key_t& key, proc_stats_t* stats);
+
+    // Queue a result; it is written by flush()
+    void insert(const cache_key_t& key, const proc_stats_t& stats);
+
+    // Append the queued results to the file under an exclusive lock, skipping those
+    // another process has stored since open()
+    bool flush();
+
+    const cache_stats_t& stats() const { return counters; }
+
+private:
+    struct KeyHash {
+        size_t operator()(const cache_key_t& key) const { return (size_t)fnv1a_64(&key, sizeof(key)); }
+    };
+    struct KeyEqual {
+        bool operator()(const cache_key_t& a, const cache_key_t& b) const;
+    };
+
+    bool header_current();
+    bool reset();
+    bool load(off_t from, off_t to);
+
+    int fd;
+    off_t loaded_end;         // File offset up to which the entries are in memory
+    std::unordered_map<cache_key_t, proc_stats_t, KeyHash, KeyEqual> entries;
+    std::vector<cache_entry_t> pending;
+    cache_stats_t counters;
+};
+
+#endif /* PROCSIM_CACHE_HPP */
@@ -3,10 +3,44 @@
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "procsim.hpp"
+#include "processor.hpp"
+#include "procsim_trace.hpp"
+#include "procsim_prefetch.hpp"
+#include "procsim_sweep.hpp"
+#include "procsim_analyze.hpp"
+#include "procsim_multicore.hpp"
+#include "procsim_sampling.hpp"
+#include "procsim_segment.hpp"
+#include "procsim_cache.hpp"
+#include "procsim_interval.hpp"
+#include <chrono>
+#include <thread>
 
 FILE* inFile = stdin;
 
+// Trace input, detected from the first bytes of the input by open_trace()
+enum trace_mode_t {
+    TRACE_TEXT,          // "%x %d %d %d %d" lines (parsed by trace_text_read)
+    TRACE_BIN_MMAP,      // Binary trace mapped into memory (regular files)
+    TRACE_BIN_STREAM     // Binary trace read with fread (pipes)
+};
+trace_mode_t trace_mode = TRACE_TEXT;
+const trace_bin_record_t* trace_records = NULL;  // Mapped records (TRACE_BIN_MMAP)
+const trace_dep_record_t* trace_deps = NULL;     // Mapped annotated records (TRACE_BIN_MMAP)
+bool trace_has_deps = false;                     // Binary trace with producer distances
+uint64_t trace_record_count = 0;                 // Records in a binary trace
+uint64_t trace_next_record = 0;                  // Next record to hand out
+
+// Top-down category names, in disp_slot_t / issue_slot_t order (also the JSON keys)
+const char* disp_slot_names[NUM_DISP_SLOTS] = { "used", "rs_full", "empty", "rob_full", "prf_full" };
+const char* issue_slot_names[NUM_ISSUE_SLOTS] = { "used", "fu_busy", "cdb", "dependency", "empty" };
+
+// Background reader (NULL when reading synchronously). Never deleted: it lives until exit.
+TracePrefetcher* prefetcher = NULL;
+
 void print_help_and_exit(void) {
     printf("procsim [OPTIONS]\n");
     printf("  -j k0\t\tNumber of k0 FUs\n");
@@ -14,11 +48,147 @@ void print_help_and_exit(void) {
     printf("  -l k2\t\tNumber of k2 FUs\n");   
     printf("  -f N\t\tNumber of instructions to fetch\n");
     printf("  -r R\t\tNumber of result buses\n");
-    printf("  -i traces/file.trace\n");
+    printf("  -i traces/file.trace\tText trace, or binary trace from trace2bin (default: stdin)\n");
+    printf("    \t\trepeat -i for SMT: one hardware thread per trace, sharing the RS, FUs and result buses\n");
+    printf("  -M policy\tSMT fetch policy: icount (default) or rr (round-robin)\n");
+    printf("  -m N\t\tMulti-core: every -i trace runs on its own core and host thread, the cores\n");
+    printf("    \t\tsynchronizing every N cycles (0 = %d); prints socket totals, -v adds per-core stats\n",
+           DEFAULT_MULTICORE_QUANTUM);
+    printf("  -p N\t\tPrefetch ring size in batches of %d instructions, up to %d, 0 = read synchronously\n",
+           PREFETCH_BATCH_SIZE, MAX_PREFETCH_BATCHES);
+    printf("    \t\t(default %d)\n", DEFAULT_PREFETCH_BATCHES);
+    printf("  -L a,b,c\tLatency of k0,k1,k2 FUs in cycles (default %d)\n", DEFAULT_FU_LATENCY);
+    printf("  -I a,b,c\tIssue interval of k0,k1,k2 FUs, 1 = fully pipelined, 0 = blocking (default)\n");
+    printf("  -u fu.cfg\tFU timing file (\"k1.latency = 3\", \"k2.interval = blocking\", ...)\n");
+    printf("  -q N\t\tDispatch queue capacity, fetch stalls when full (default 0 = unbounded)\n");
+    printf("  -d file\tWrite the per-instruction timeline (INST FETCH DISP SCHED EXEC STATE), - = stdout\n");
+    printf("  -v\t\tPrint run statistics and the top-down slot breakdown after the cycle count\n");
+    printf("  -J file\tWrite the run statistics as JSON, - = stdout\n");
+    printf("  -T N\t\tWrite a CSV row of interval statistics every N cycles\n");
+    printf("  -o file\tDestination of the -T time series (default: stdout)\n");
+    printf("  -x file\tWrite a Chrome trace-event JSON timeline (open in Perfetto / chrome://tracing)\n");
+    printf("  -b N\t\tReorder buffer entries, in-order commit (default 0 = retire from the RS)\n");
+    printf("  -C N\t\tROB commit width (default 0 = fetch width)\n");
+    printf("  -Q N\t\tUnified reservation station entries (default 0 = 2 * (k0 + k1 + k2))\n");
+    printf("  -S a,b,c\tSeparate reservation station queues for k0,k1,k2 FUs, 0 = 2 * FUs of the type\n");
+    printf("  -P N\t\tPhysical registers for explicit renaming, > %d (default 0 = unlimited)\n", NUM_ARCH_REGS);
+    printf("  -Z P,W,M\tSampled simulation: in every P instructions, warm up W and measure M in detail,\n");
+    printf("    \t\tfast-forward the rest; prints estimated cycles and IPC with 95%% confidence intervals\n");
+    printf("  -K N[,W]\tSegmented simulation: split the trace into N segments simulated in parallel (-t\n");
+    printf("    \t\tthreads), each after a warm-up of W instructions (default %d); -v adds the\n",
+           DEFAULT_SEGMENT_WARMUP);
+    printf("    \t\tper-segment cycles and the error against a full serial run\n");
+    printf("  -e\t\tDisable idle-cycle skipping (simulate every cycle)\n");
+    printf("  -s\t\tSweep mode: -r/-j/-k/-l/-f take lists and ranges (e.g. 1,2,4 or 2-16:2),\n");
+    printf("    \t\tevery combination is simulated over one in-memory trace, CSV on stdout\n");
+    printf("  -c configs\tSweep the configurations listed in a file (\"R k0 k1 k2 F\" per line)\n");
+    printf("  -t N\t\tSweep worker threads (default: number of host CPUs)\n");
+    printf("  -A N\t\tInterval-model sweep: predict every -s/-c configuration analytically, fitted\n");
+    printf("    \t\tto N detailed runs (0 = %d); CSV with the bottleneck and near-front flag\n",
+           DEFAULT_INTERVAL_CALIBRATION);
+    printf("  -X file\tSweep result cache shared by concurrent runs: cached (trace, settings,\n");
+    printf("    \t\tconfiguration) results are not simulated again; emptied by a new build\n");
+    printf("  -a\t\tAnalysis mode: critical path and IPC ceilings of the trace under unlimited\n");
+    printf("    \t\tresources and under each -r/-j/-k/-l limit alone, dependence distances, op mix\n");
+    printf("  -w N\t\tInstruction window of the -a models (default %d)\n", DEFAULT_ANALYZE_WINDOW);
     printf("  -h\t\tThis helpful output\n");
     exit(0);
 }
 
+//
+// open_trace
+//
+//  detects the trace format of inFile from its magic number and, for binary traces
+//  in regular files, maps the whole trace into memory
+//
+void open_trace(void)
+{
+    int c = getc(inFile);
+    if (c == EOF) {
+        return;  // Empty trace
+    }
+    ungetc(c, inFile);
+    if (c != (unsigned char)TRACE_BIN_MAGIC[0]) {
+        trace_mode = TRACE_TEXT;
+        return;
+    }
+
+    trace_bin_header_t header;
+    if (fread(&header, sizeof(header), 1, inFile) != 1 || !trace_bin_header_valid(&header)) {
+        fprintf(stderr, trace_bin_foreign_byte_order(&header) ?
+                "Binary trace was written on a host with the other byte order; convert it again with trace2bin\n" :
+                "Input is not a valid binary trace (bad header)\n");
+        exit(1);
+    }
+    trace_record_count = header.record_count;
+    trace_has_deps = trace_bin_has_deps(&header);
+    trace_mode = TRACE_BIN_STREAM;
+
+    // Map the file if we can; otherwise keep streaming records with fread
+    struct stat st;
+    int fd = fileno(inFile);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && ftell(inFile) == (long)sizeof(header)) {
+        uint64_t needed = sizeof(header) + trace_record_count * header.record_size;
+        if ((uint64_t)st.st_size < needed) {
+            fprintf(stderr, "Binary trace is truncated (%" PRIu64 " records expected)\n", trace_record_count);
+            exit(1);
+        }
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            if (trace_has_deps) {
+                trace_deps = (const trace_dep_record_t*)((const char*)map + sizeof(header));
+            } else {
+                trace_records = (const trace_bin_record_t*)((const char*)map + sizeof(header));
+            }
+            trace_mode = TRACE_BIN_MMAP;
+        }
+    }
+}
+
+//
+// parse_instruction
+//
+//  reads the next instruction from the trace in whatever format open_trace() found
+//  returns true if an instruction was read successfully
+//
+bool parse_instruction(proc_inst_t* p_inst)
+{
+    if (trace_mode == TRACE_BIN_MMAP) {
+        if (trace_next_record >= trace_record_count) {
+            return false;
+        }
+        if (trace_has_deps) {
+            trace_dep_decode(&trace_deps[trace_next_record++], p_inst);
+        } else {
+            trace_bin_decode(&trace_records[trace_next_record++], p_inst);
+        }
+        return true;
+    }
+    
+    if (trace_mode == TRACE_BIN_STREAM && trace_has_deps) {
+        trace_dep_record_t rec;
+        if (trace_next_record >= trace_record_count || fread(&rec, sizeof(rec), 1, inFile) != 1) {
+            return false;
+        }
+        trace_next_record++;
+        trace_dep_decode(&rec, p_inst);
+        return true;
+    }
+    
+    if (trace_mode == TRACE_BIN_STREAM) {
+        trace_bin_record_t rec;
+        if (trace_next_record >= trace_record_count || fread(&rec, sizeof(rec), 1, inFile) != 1) {
+            return false;
+        }
+        trace_next_record++;
+        trace_bin_decode(&rec, p_inst);
+        return true;
+    }
+    
+    return trace_text_read(inFile, p_inst);
+}
+
 //
 // read_instruction
 //
@@ -26,24 +196,156 @@ void print_help_and_exit(void) {
 //
 bool read_instruction(proc_inst_t* p_inst)
 {
-    int ret;
-    
     if (p_inst == NULL)
     {
         fprintf(stderr, "Fetch requires a valid pointer to populate\n");
         return false;
     }
     
-    ret = fscanf(stdin, "%x %d %d %d %d\n", &p_inst->instruction_address,
-                 &p_inst->op_code, &p_inst->dest_reg, &p_inst->src_reg[0], &p_inst->src_reg[1]); 
-    if (ret != 5) {
+    if (prefetcher != NULL) {
+        return prefetcher->next(p_inst);
+    }
+    return parse_instruction(p_inst);
+}
+
+//
+// parse_fu_list
+//
+//  parses "a,b,c" (one value per FU type, 0 to MAX_FU_CYCLES) into the latency or interval field
+//  returns false on a malformed list
+//
+bool parse_fu_list(const char* spec, fu_timing_t timing[3], bool latency)
+{
+    uint64_t values[3];
+    if (!parse_count_list(spec, 3, 0, MAX_FU_CYCLES, values)) {
         return false;
     }
-    
+    for (int t = 0; t < 3; t++) {
+        if (latency) {
+            timing[t].latency = values[t];
+        } else {
+            timing[t].interval = values[t];
+        }
+    }
     return true;
 }
 
+//
+// load_fu_config
+//
+//  reads FU timing settings, one "k<type>.<latency|interval> = <value>" per line
+//  ('#' starts a comment); values range up to MAX_FU_CYCLES, and the interval also
+//  accepts "blocking" (0) and "pipelined" (1)
+//  returns false if the file cannot be read or a line is malformed
+//
+bool load_fu_config(const char* path, fu_timing_t timing[3])
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", path);
+        return false;
+    }
+
+    char line[256];
+    int line_no = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        int type;
+        char key[32];
+        char value[32];
+        int n = sscanf(line, " k%d.%31[a-z] = %31s", &type, key, value);
+        if (n == EOF || (n <= 0 && strspn(line, " \t\r\n") == strlen(line))) {
+            continue;  // Blank line
+        }
+        if (n != 3 || type < 0 || type > 2) {
+            ok = false;
+        } else if (strcmp(key, "latency") == 0) {
+            ok = parse_count(value, 1, MAX_FU_CYCLES, &timing[type].latency);
+        } else if (strcmp(key, "interval") == 0) {
+            if (strcmp(value, "blocking") == 0) {
+                timing[type].interval = 0;
+            } else if (strcmp(value, "pipelined") == 0) {
+                timing[type].interval = 1;
+            } else {
+                ok = parse_count(value, 0, MAX_FU_CYCLES, &timing[type].interval);
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: expected \"k<0-2>.latency = N\" or \"k<0-2>.interval = N|blocking|pipelined\""
+                    " (N up to %d)\n", path, line_no, MAX_FU_CYCLES);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+//
+// Default processor behind setup_proc/run_proc/complete_proc, fed by read_instruction
+//
+Processor default_processor;
+
+static bool read_instruction_source(void* ctx, proc_inst_t* p_inst)
+{
+    return read_instruction(p_inst);
+}
+
+void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f)
+{
+    default_processor.set_source(read_instruction_source, NULL);
+    default_processor.setup(r, k0, k1, k2, f);
+}
+
+//
+// report_stuck_and_exit
+//
+//  reports a processor whose pipeline stopped making progress (see Processor::stuck)
+//
+void report_stuck_and_exit(const Processor& proc)
+{
+    fprintf(stderr, "ERROR: No progress for %d cycles and nothing in flight (cycle %lu). Possible infinite loop!\n",
+            RUNAWAY_CYCLES, proc.cycle_count());
+    proc.dump_state(stderr);
+    exit(1);
+}
+
+//
+// report_stuck_configs
+//
+//  reports sweep configurations that got stuck (their CSV rows say so)
+//  and returns the exit status of the sweep
+//
+int report_stuck_configs(uint64_t stuck)
+{
+    if (stuck == 0) {
+        return 0;
+    }
+    fprintf(stderr, "ERROR: %" PRIu64 " configuration(s) stopped making progress (status \"stuck\" in the CSV)\n",
+            stuck);
+    return 1;
+}
+
+void run_proc(proc_stats_t* p_stats)
+{
+    if (!default_processor.run(p_stats)) {
+        report_stuck_and_exit(default_processor);
+    }
+}
+
+void complete_proc(proc_stats_t* p_stats)
+{
+    default_processor.complete(p_stats);
+}
+
 void print_statistics(proc_stats_t* p_stats);
+bool write_statistics_json(const char* path, const proc_stats_t* p_stats,
+                           const std::vector<proc_stats_t>* per_core = NULL);
 
 int main(int argc, char* argv[]) {
     int opt;
@@ -52,32 +354,266 @@ int main(int argc, char* argv[]) {
     uint64_t k1 = DEFAULT_K1;
     uint64_t k2 = DEFAULT_K2;
     uint64_t r = DEFAULT_R;
+    uint64_t prefetch_batches = DEFAULT_PREFETCH_BATCHES;
+    uint64_t dispatch_capacity = DEFAULT_DISPATCH_CAPACITY;
+    uint64_t rob_size = DEFAULT_ROB_SIZE;
+    uint64_t commit_width = DEFAULT_COMMIT_WIDTH;
+    uint64_t prf_size = DEFAULT_PRF_SIZE;
+    uint64_t rs_size = 0;
+    bool rs_distributed = false;
+    uint64_t rs_queues[3] = { 0, 0, 0 };
+    std::vector<FILE*> smt_inputs;     // Traces of SMT threads 1.. (thread 0 reads inFile)
+    smt_fetch_policy_t fetch_policy = SMT_FETCH_ICOUNT;
+    bool have_input = false;
+    bool multicore = false;
+    uint64_t multicore_quantum = DEFAULT_MULTICORE_QUANTUM;
+    bool sampled = false;
+    sample_config_t sample_config;
+    uint64_t segments = 0;
+    uint64_t segment_warmup = DEFAULT_SEGMENT_WARMUP;
+    bool segment_warmup_given = false;
+    bool idle_skip = true;
+    FILE* retire_log = NULL;
+    bool verbose = false;
+    const char* json_path = NULL;
+    uint64_t telemetry_interval = 0;
+    const char* telemetry_path = NULL;
+    FILE* pipeline_trace = NULL;
+    fu_timing_t fu_timing[3];
+    for (int t = 0; t < 3; t++) {
+        fu_timing[t].latency = DEFAULT_FU_LATENCY;
+        fu_timing[t].interval = DEFAULT_FU_INTERVAL;
+    }
+    bool sweep = false;
+    bool analyze = false;
+    uint64_t analyze_window = DEFAULT_ANALYZE_WINDOW;
+    const char* sweep_config_file = NULL;
+    unsigned sweep_threads = std::thread::hardware_concurrency();
+    const char* cache_path = NULL;
+    bool interval = false;
+    unsigned interval_calibration = DEFAULT_INTERVAL_CALIBRATION;
+    const char* r_spec = NULL;
+    const char* k0_spec = NULL;
+    const char* k1_spec = NULL;
+    const char* k2_spec = NULL;
+    const char* f_spec = NULL;
 
     /* Read arguments */ 
-    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:h"))) {
+    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:p:L:I:u:q:b:C:P:Q:S:M:m:Z:K:d:vJ:T:o:x:esc:t:X:A:aw:h"))) {
         switch(opt) {
         case 'r':
             r = atoi(optarg);
+            r_spec = optarg;
             break;
         case 'j':
             k0 = atoi(optarg);
+            k0_spec = optarg;
             break;
         case 'k':
             k1 = atoi(optarg);
+            k1_spec = optarg;
             break;
         case 'l':
             k2 = atoi(optarg);
+            k2_spec = optarg;
             break;
         case 'f':
             f = atoi(optarg);
+            f_spec = optarg;
+            break;
+        case 'L':
+            if (!parse_fu_list(optarg, fu_timing, true)) {
+                fprintf(stderr, "-L expects three latencies up to %d, e.g. 1,3,20\n", MAX_FU_CYCLES);
+                print_help_and_exit();
+            }
+            break;
+        case 'I':
+            if (!parse_fu_list(optarg, fu_timing, false)) {
+                fprintf(stderr, "-I expects three issue intervals up to %d, e.g. 0,1,0\n", MAX_FU_CYCLES);
+                print_help_and_exit();
+            }
+            break;
+        case 'u':
+            if (!load_fu_config(optarg, fu_timing)) {
+                return 1;
+            }
+            break;
+        case 'q':
+            if (!parse_count(optarg, 0, UINT32_MAX, &dispatch_capacity)) {
+                fprintf(stderr, "-q expects a queue capacity (0 = unbounded)\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'b':
+            if (!parse_count(optarg, 0, UINT32_MAX, &rob_size)) {
+                fprintf(stderr, "-b expects a reorder buffer size (0 = no ROB)\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'C':
+            if (!parse_count(optarg, 0, UINT32_MAX, &commit_width)) {
+                fprintf(stderr, "-C expects a commit width (0 = fetch width)\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'P':
+            if (!parse_count(optarg, 0, UINT32_MAX, &prf_size) ||
+                (prf_size > 0 && prf_size <= NUM_ARCH_REGS)) {
+                fprintf(stderr, "-P needs more than %d physical registers\n", NUM_ARCH_REGS);
+                print_help_and_exit();
+            }
+            break;
+        case 'Q':
+            if (!parse_count(optarg, 0, UINT32_MAX, &rs_size)) {
+                fprintf(stderr, "-Q expects a reservation station size (0 = 2 * (k0 + k1 + k2))\n");
+                print_help_and_exit();
+            }
+            rs_distributed = false;
+            break;
+        case 'S':
+            // Same per-queue cap as -Q, so the three queues together still fit a uint64_t
+            if (!parse_count_list(optarg, 3, 0, UINT32_MAX, rs_queues)) {
+                fprintf(stderr, "-S expects three queue sizes from 0 to %" PRIu32 ", e.g. 4,8,8\n", UINT32_MAX);
+                print_help_and_exit();
+            }
+            rs_distributed = true;
+            break;
+        case 'm':
+            if (!parse_count(optarg, 0, UINT32_MAX, &multicore_quantum)) {
+                fprintf(stderr, "-m expects a quantum in cycles (0 = %d)\n", DEFAULT_MULTICORE_QUANTUM);
+                print_help_and_exit();
+            }
+            multicore = true;
+            break;
+        case 'Z': {
+            uint64_t fields[3];
+            if (!parse_count_list(optarg, 3, 0, UINT64_MAX, fields) || fields[2] == 0 ||
+                fields[1] > fields[0] || fields[2] > fields[0] - fields[1]) {
+                fprintf(stderr, "-Z expects period,warmup,measure with warmup + measure <= period, e.g. 1000000,2000,1000\n");
+                print_help_and_exit();
+            }
+            sample_config.period = fields[0];
+            sample_config.warmup = fields[1];
+            sample_config.measure = fields[2];
+            sampled = true;
+            break;
+        }
+        case 'K': {
+            const char* end;
+            bool ok = parse_count_prefix(optarg, 1, UINT64_MAX, &segments, &end);
+            segment_warmup_given = ok && *end == ',';
+            if (segment_warmup_given) {
+                ok = parse_count(end + 1, 0, UINT64_MAX, &segment_warmup);
+            } else if (ok) {
+                ok = (*end == '\0');
+            }
+            if (!ok) {
+                fprintf(stderr, "-K expects segments[,warmup], e.g. 16,10000\n");
+                print_help_and_exit();
+            }
             break;
-        case 'i':
-            inFile = fopen(optarg, "r");
-            if (inFile == NULL)
+        }
+        case 'd':
+            retire_log = (strcmp(optarg, "-") == 0) ? stdout : fopen(optarg, "w");
+            if (retire_log == NULL) {
+                fprintf(stderr, "Failed to open %s for writing\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'J':
+            json_path = optarg;
+            break;
+        case 'T':
+            if (!parse_count(optarg, 1, UINT64_MAX, &telemetry_interval)) {
+                fprintf(stderr, "-T expects a sampling interval of at least 1 cycle\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'o':
+            telemetry_path = optarg;
+            break;
+        case 'x':
+            pipeline_trace = fopen(optarg, "w");
+            if (pipeline_trace == NULL) {
+                fprintf(stderr, "Failed to open %s for writing\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'e':
+            idle_skip = false;
+            break;
+        case 's':
+            sweep = true;
+            break;
+        case 'c':
+            sweep = true;
+            sweep_config_file = optarg;
+            break;
+        case 't': {
+            uint64_t threads;
+            if (!parse_count(optarg, 1, MAX_SWEEP_THREADS, &threads)) {
+                fprintf(stderr, "-t expects 1 to %d worker threads\n", MAX_SWEEP_THREADS);
+                print_help_and_exit();
+            }
+            sweep_threads = threads;
+            break;
+        }
+        case 'X':
+            cache_path = optarg;
+            break;
+        case 'A': {
+            uint64_t calibration;
+            if (!parse_count(optarg, 0, UINT32_MAX, &calibration)) {
+                fprintf(stderr, "-A expects a number of calibration runs (0 = %d)\n",
+                        DEFAULT_INTERVAL_CALIBRATION);
+                print_help_and_exit();
+            }
+            interval = true;
+            interval_calibration = (calibration > 0) ? calibration : DEFAULT_INTERVAL_CALIBRATION;
+            break;
+        }
+        case 'a':
+            analyze = true;
+            break;
+        case 'w':
+            if (!parse_count(optarg, 1, MAX_ANALYZE_WINDOW, &analyze_window)) {
+                fprintf(stderr, "-w expects a window of 1 to %d instructions\n", MAX_ANALYZE_WINDOW);
+                print_help_and_exit();
+            }
+            break;
+        case 'p':
+            if (!parse_count(optarg, 0, MAX_PREFETCH_BATCHES, &prefetch_batches)) {
+                fprintf(stderr, "-p expects a ring size from 0 to %d batches\n", MAX_PREFETCH_BATCHES);
+                print_help_and_exit();
+            }
+            break;
+        case 'i': {
+            FILE* file = fopen(optarg, "r");
+            if (file == NULL)
             {
                 fprintf(stderr, "Failed to open %s for reading\n", optarg);
                 print_help_and_exit();
             }
+            if (have_input) {
+                smt_inputs.push_back(file);
+            } else {
+                inFile = file;
+                have_input = true;
+            }
+            break;
+        }
+        case 'M':
+            if (strcmp(optarg, "icount") == 0) {
+                fetch_policy = SMT_FETCH_ICOUNT;
+            } else if (strcmp(optarg, "rr") == 0) {
+                fetch_policy = SMT_FETCH_ROUND_ROBIN;
+            } else {
+                fprintf(stderr, "-M expects icount or rr\n");
+                print_help_and_exit();
+            }
             break;
         case 'h':
             /* Fall through */
@@ -95,7 +631,277 @@ int main(int argc, char* argv[]) {
     // printf("F: %"  PRIu64 "\n", f);
     // printf("\n");
 
+    if (smt_inputs.size() + 1 > MAX_SMT_THREADS && !multicore) {
+        fprintf(stderr, "At most %d traces (SMT threads)\n", MAX_SMT_THREADS);
+        return 1;
+    }
+    if (multicore && (retire_log != NULL || pipeline_trace != NULL || telemetry_interval > 0)) {
+        fprintf(stderr, "The -d, -x and -T outputs follow a single core, not a multi-core run\n");
+        return 1;
+    }
+    if ((!smt_inputs.empty() || multicore) && (sweep || analyze)) {
+        fprintf(stderr, "Sweep and analysis modes take a single trace\n");
+        return 1;
+    }
+    if (segments > 0 && (!smt_inputs.empty() || multicore || sampled || sweep || analyze ||
+                         retire_log != NULL || pipeline_trace != NULL || telemetry_interval > 0 ||
+                         json_path != NULL)) {
+        fprintf(stderr, "Segmented simulation (-K) runs a single trace and prints its own estimate\n");
+        return 1;
+    }
+    if (cache_path != NULL && (!sweep || interval)) {
+        fprintf(stderr, "The result cache (-X) serves detailed sweeps (-s, -c)\n");
+        return 1;
+    }
+    if (interval && !sweep) {
+        fprintf(stderr, "The interval model (-A) predicts the configurations of a sweep (-s, -c)\n");
+        return 1;
+    }
+    if (sampled && (!smt_inputs.empty() || multicore || sweep || analyze || retire_log != NULL ||
+                    pipeline_trace != NULL || telemetry_interval > 0 || json_path != NULL)) {
+        fprintf(stderr, "Sampled simulation (-Z) runs a single trace and prints its own estimate\n");
+        return 1;
+    }
+
+    /* Detect the trace format (text or binary) */
+    open_trace();
+
+    /* Parse ahead on a second thread; a mapped binary trace is already in memory */
+    if (prefetch_batches > 0 && trace_mode != TRACE_BIN_MMAP) {
+        prefetcher = new TracePrefetcher();
+        prefetcher->start(parse_instruction, prefetch_batches);
+    }
+
+    if (analyze) {
+        /* One streaming pass over the trace, no cycle simulation */
+        analyze_config_t config;
+        config.r = r;
+        config.k[0] = k0;
+        config.k[1] = k1;
+        config.k[2] = k2;
+        for (int t = 0; t < 3; t++) {
+            config.fu_timing[t] = fu_timing[t];
+            if (config.fu_timing[t].latency == 0) {
+                config.fu_timing[t].latency = 1;
+            }
+        }
+        config.window = analyze_window;
+        analyze_trace(config, stdout);
+        return 0;
+    }
+
+    /* Settings shared by every run, applied before setup */
+    for (int t = 0; t < 3; t++) {
+        default_processor.set_fu_timing(t, fu_timing[t]);
+    }
+    default_processor.set_dispatch_capacity(dispatch_capacity);
+    default_processor.set_rob(rob_size, commit_width);
+    default_processor.set_prf(prf_size);
+    if (rs_distributed) {
+        default_processor.set_rs_queues(rs_queues[0], rs_queues[1], rs_queues[2]);
+    } else {
+        default_processor.set_rs_size(rs_size);
+    }
+    default_processor.set_idle_skip(idle_skip);
+    default_processor.set_smt(multicore ? 1 : smt_inputs.size() + 1, fetch_policy);
+
+    if (segments > 0) {
+        /* Simulate the segments of the in-memory trace side by side, then stitch them */
+        std::vector<trace_dep_record_t> trace;
+        if (!load_trace(trace)) {
+            return 1;
+        }
+        if (segments > trace.size()) {
+            fprintf(stderr, "-K asks for %" PRIu64 " segments, but the trace has %zu instructions\n", segments,
+                    trace.size());
+            return 1;
+        }
+        /* No segment replays more than the instructions before the last one */
+        uint64_t usable_warmup = trace.size() * (segments - 1) / segments;
+        if (segment_warmup_given && segment_warmup > usable_warmup) {
+            fprintf(stderr, "-K warm-up of %" PRIu64 " instructions, but the last segment starts at instruction %" PRIu64 "\n",
+                    segment_warmup, usable_warmup);
+            return 1;
+        }
+        std::vector<segment_result_t> results;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        uint64_t cycles = run_segmented(trace, default_processor, r, k0, k1, k2, f, segments,
+                                        segment_warmup, sweep_threads, results);
+        for (size_t s = 0; s < results.size(); s++) {
+            if (results[s].stuck) {
+                fprintf(stderr, "ERROR: Segment %zu stopped making progress. Possible infinite loop!\n", s);
+                return 1;
+            }
+        }
+        double parallel_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        printf("%" PRIu64 "\n", cycles);
+        if (verbose) {
+            for (size_t s = 0; s < results.size(); s++) {
+                printf("Segment %zu: instructions %" PRIu64 "-%" PRIu64 ", warm-up %" PRIu64 ", %" PRIu64 " cycles\n",
+                       s, results[s].start, results[s].start + results[s].count - 1, results[s].warmup,
+                       results[s].cycles);
+            }
+
+            // Reference: the same trace simulated serially in full
+            Processor serial(default_processor);
+            serial.set_source_span(trace.data(), trace.size());
+            serial.setup(r, k0, k1, k2, f);
+            t0 = std::chrono::steady_clock::now();
+            proc_stats_t stats;
+            memset(&stats, 0, sizeof(proc_stats_t));
+            if (!serial.run(&stats)) {
+                report_stuck_and_exit(serial);
+            }
+            double serial_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            printf("Serial run: %lu cycles, segmented estimate error %+.3f%%\n", stats.cycle_count,
+                   stats.cycle_count > 0 ? 100.0 * ((double)cycles - stats.cycle_count) / stats.cycle_count : 0.0);
+            printf("Wall time: segmented %.3f s, serial %.3f s (%.1fx)\n", parallel_time, serial_time,
+                   parallel_time > 0.0 ? serial_time / parallel_time : 0.0);
+        }
+        return 0;
+    }
+
+    if (sampled) {
+        /* Detailed windows over a fast-forwarded trace, extrapolated to the whole trace */
+        sample_result_t result;
+        if (!run_sampled(default_processor, read_instruction_source, NULL, r, k0, k1, k2, f, sample_config,
+                         &result)) {
+            fprintf(stderr, "ERROR: A detailed window stopped making progress. Possible infinite loop!\n");
+            return 1;
+        }
+        printf("%.0f\n", result.cycles);
+        printf("Sampled simulation: %" PRIu64 " windows, %" PRIu64 " of %" PRIu64 " instructions in detail (%.2f%%)\n",
+               result.samples, result.detailed_instructions, result.total_instructions,
+               result.total_instructions > 0 ? 100.0 * result.detailed_instructions / result.total_instructions : 0.0);
+        if (result.samples < 2) {
+            printf("Estimated cycles: %.0f (%s)\n", result.cycles,
+                   result.samples == 0 ? "whole trace simulated" : "one window, no confidence interval");
+            printf("Estimated IPC: %f\n", result.ipc);
+        } else {
+            printf("Estimated cycles: %.0f +/- %.0f (95%% confidence, +/- %.2f%%)\n", result.cycles,
+                   result.cycles_error, 100.0 * result.cpi_error / result.cpi_mean);
+            printf("Estimated IPC: %f [%f, %f]\n", result.ipc, result.ipc_low, result.ipc_high);
+            printf("Window CPI: mean %f, standard deviation %f\n", result.cpi_mean, result.cpi_stddev);
+        }
+        return 0;
+    }
+
+    if (multicore) {
+        /* One core per trace: core 0 reads the main input, the others their own stream */
+        std::vector<Processor> cores(smt_inputs.size() + 1, default_processor);
+        std::vector<Processor*> core_ptrs;
+        cores[0].set_source(read_instruction_source, NULL);
+        for (size_t c = 0; c < cores.size(); c++) {
+            if (c > 0 && !cores[c].set_source_stream(smt_inputs[c - 1])) {
+                fprintf(stderr, "Input %zu is not a valid binary trace (bad header)\n", c + 1);
+                return 1;
+            }
+            cores[c].setup(r, k0, k1, k2, f);
+            core_ptrs.push_back(&cores[c]);
+        }
+        run_multicore(core_ptrs, multicore_quantum, NULL, NULL);
+        for (size_t c = 0; c < cores.size(); c++) {
+            if (cores[c].stuck()) {
+                fprintf(stderr, "Core %zu:\n", c);
+                report_stuck_and_exit(cores[c]);
+            }
+        }
+
+        std::vector<proc_stats_t> core_stats(cores.size());
+        for (size_t c = 0; c < cores.size(); c++) {
+            memset(&core_stats[c], 0, sizeof(proc_stats_t));
+            cores[c].complete(&core_stats[c]);
+        }
+        proc_stats_t stats;
+        aggregate_stats(core_stats, &stats);
+        printf("%lu\n", stats.cycle_count);
+        if (verbose) {
+            print_statistics(&stats);
+            for (size_t c = 0; c < core_stats.size(); c++) {
+                printf("Core %zu: %lu cycles, %lu instructions, IPC %f\n", c, core_stats[c].cycle_count,
+                       core_stats[c].retired_instruction, core_stats[c].avg_inst_retired);
+            }
+        }
+        if (json_path != NULL && !write_statistics_json(json_path, &stats, &core_stats)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    if (sweep) {
+        /* Build the configuration list */
+        std::vector<sweep_config_t> configs;
+        if (sweep_config_file != NULL) {
+            if (!load_sweep_configs(sweep_config_file, configs)) {
+                return 1;
+            }
+        } else {
+            // Parameters not given on the command line stay at their defaults
+            std::vector<uint64_t> rs(1, DEFAULT_R), k0s(1, DEFAULT_K0), k1s(1, DEFAULT_K1),
+                                  k2s(1, DEFAULT_K2), fs(1, DEFAULT_F);
+            bool ok = true;
+            if (r_spec)  { rs.clear();  ok = ok && parse_sweep_values(r_spec, rs); }
+            if (k0_spec) { k0s.clear(); ok = ok && parse_sweep_values(k0_spec, k0s); }
+            if (k1_spec) { k1s.clear(); ok = ok && parse_sweep_values(k1_spec, k1s); }
+            if (k2_spec) { k2s.clear(); ok = ok && parse_sweep_values(k2_spec, k2s); }
+            if (f_spec)  { fs.clear();  ok = ok && parse_sweep_values(f_spec, fs); }
+            if (!ok) {
+                fprintf(stderr, "Malformed sweep range (values 1-%d, lo <= hi, step >= 1)\n", MAX_SWEEP_PARAM);
+                print_help_and_exit();
+            }
+            double total = (double)rs.size() * k0s.size() * k1s.size() * k2s.size() * fs.size();
+            if (total > MAX_SWEEP_CONFIGS) {
+                fprintf(stderr, "The sweep expands to %.0f configurations, more than %d\n", total,
+                        MAX_SWEEP_CONFIGS);
+                print_help_and_exit();
+            }
+            expand_sweep_configs(rs, k0s, k1s, k2s, fs, configs);
+        }
+
+        /* Parse the trace once, then simulate every configuration over it */
+        std::vector<trace_dep_record_t> trace;
+        if (!load_trace(trace)) {
+            return 1;
+        }
+        if (interval) {
+            run_interval_sweep(trace, configs, default_processor, fu_timing, interval_calibration,
+                               sweep_threads, stdout, stderr);
+            return 0;
+        }
+        if (cache_path == NULL) {
+            return report_stuck_configs(run_sweep(trace, configs, default_processor, sweep_threads, stdout));
+        }
+        ResultCache cache;
+        if (!cache.open(cache_path)) {
+            fprintf(stderr, "Failed to open the result cache %s\n", cache_path);
+            return 1;
+        }
+        uint64_t stuck = run_sweep(trace, configs, default_processor, sweep_threads, stdout, &cache);
+        const cache_stats_t& cs = cache.stats();
+        fprintf(stderr, "Result cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " stored, "
+                "%" PRIu64 " entries loaded, %" PRIu64 " stale entries discarded\n",
+                cs.hits, cs.misses, cs.stored, cs.loaded, cs.discarded);
+        return report_stuck_configs(stuck);
+    }
+
     /* Setup the processor */
+    default_processor.set_retire_log(retire_log);
+    default_processor.set_pipeline_trace(pipeline_trace);
+    if (telemetry_interval > 0) {
+        FILE* telemetry = (telemetry_path == NULL || strcmp(telemetry_path, "-") == 0) ?
+                          stdout : fopen(telemetry_path, "w");
+        if (telemetry == NULL) {
+            fprintf(stderr, "Failed to open %s for writing\n", telemetry_path);
+            return 1;
+        }
+        default_processor.set_interval_log(telemetry, telemetry_interval);
+    }
+    for (size_t t = 0; t < smt_inputs.size(); t++) {
+        if (!default_processor.set_source_stream(t + 1, smt_inputs[t])) {
+            fprintf(stderr, "Input %zu is not a valid binary trace (bad header)\n", t + 2);
+            return 1;
+        }
+    }
     setup_proc(r, k0, k1, k2, f);
 
     /* Setup statistics */
@@ -113,6 +919,13 @@ int main(int argc, char* argv[]) {
 
     printf("%lu\n",stats.cycle_count);
 
+    if (verbose) {
+        print_statistics(&stats);
+    }
+    if (json_path != NULL && !write_statistics_json(json_path, &stats)) {
+        return 1;
+    }
+
     return 0;
 }
 
@@ -124,4 +937,111 @@ void print_statistics(proc_stats_t* p_stats) {
         printf("Avg inst fired per cycle: %f\n", p_stats->avg_inst_fired);
 	printf("Avg inst retired per cycle: %f\n", p_stats->avg_inst_retired);
 	printf("Total run time (cycles): %lu\n", p_stats->cycle_count);
+        printf("Fetch stall cycles (dispatch queue full): %lu\n", p_stats->fetch_stall_cycles);
+        printf("Cycles with dispatch queue full: %lu\n", p_stats->disp_full_cycles);
+        printf("Dispatch stall cycles (ROB full): %lu\n", p_stats->rob_full_cycles);
+        printf("Dispatch stall cycles (no free physical register): %lu\n", p_stats->prf_full_cycles);
+        printf("Dispatch stall cycles (RS full, by FU type): k0 %lu, k1 %lu, k2 %lu\n",
+               p_stats->rs_full_cycles[0], p_stats->rs_full_cycles[1], p_stats->rs_full_cycles[2]);
+
+        // Top-down breakdown: share of slots per category
+        unsigned long disp_total = 0;
+        for (int i = 0; i < NUM_DISP_SLOTS; i++) {
+            disp_total += p_stats->disp_slots[i];
+        }
+        printf("Dispatch slots:");
+        for (int i = 0; i < NUM_DISP_SLOTS; i++) {
+            printf(" %s %.1f%%", disp_slot_names[i],
+                   disp_total > 0 ? 100.0 * p_stats->disp_slots[i] / disp_total : 0.0);
+        }
+        printf("\n");
+        for (int t = 0; t < 3; t++) {
+            unsigned long issue_total = 0;
+            for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+                issue_total += p_stats->issue_slots[t][i];
+            }
+            printf("k%d issue slots:", t);
+            for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+                printf(" %s %.1f%%", issue_slot_names[i],
+                       issue_total > 0 ? 100.0 * p_stats->issue_slots[t][i] / issue_total : 0.0);
+            }
+            printf("\n");
+        }
+        printf("Result bus utilization: %.1f%% (%lu broadcasts, %lu cycles with results left waiting)\n",
+               100.0 * p_stats->bus_utilization, p_stats->bus_broadcasts, p_stats->bus_full_cycles);
+        if (p_stats->num_threads > 1) {
+            for (unsigned long t = 0; t < p_stats->num_threads; t++) {
+                printf("Thread %lu: %lu instructions, IPC %f\n", t, p_stats->thread_retired[t],
+                       p_stats->thread_ipc[t]);
+            }
+        }
+}
+
+//
+// write_statistics_json
+//
+//  writes the statistics, including the top-down slot counts, as one JSON object
+//  ("-" = stdout), plus a "cores" list for a multi-core run; returns false if the file
+//  cannot be written
+//
+bool write_statistics_json(const char* path, const proc_stats_t* p_stats,
+                           const std::vector<proc_stats_t>* per_core)
+{
+    bool to_stdout = strcmp(path, "-") == 0;
+    FILE* out = to_stdout ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"cycles\": %lu,\n", p_stats->cycle_count);
+    fprintf(out, "  \"retired_instruction\": %lu,\n", p_stats->retired_instruction);
+    fprintf(out, "  \"avg_inst_retired\": %f,\n", p_stats->avg_inst_retired);
+    fprintf(out, "  \"avg_inst_fired\": %f,\n", p_stats->avg_inst_fired);
+    fprintf(out, "  \"avg_disp_size\": %f,\n", p_stats->avg_disp_size);
+    fprintf(out, "  \"max_disp_size\": %lu,\n", p_stats->max_disp_size);
+    fprintf(out, "  \"fetch_stall_cycles\": %lu,\n", p_stats->fetch_stall_cycles);
+    fprintf(out, "  \"disp_full_cycles\": %lu,\n", p_stats->disp_full_cycles);
+    fprintf(out, "  \"rob_full_cycles\": %lu,\n", p_stats->rob_full_cycles);
+    fprintf(out, "  \"prf_full_cycles\": %lu,\n", p_stats->prf_full_cycles);
+    fprintf(out, "  \"rs_full_cycles\": [%lu, %lu, %lu],\n", p_stats->rs_full_cycles[0],
+            p_stats->rs_full_cycles[1], p_stats->rs_full_cycles[2]);
+    fprintf(out, "  \"dispatch_slots\": {");
+    for (int i = 0; i < NUM_DISP_SLOTS; i++) {
+        fprintf(out, "%s\"%s\": %lu", i > 0 ? ", " : "", disp_slot_names[i], p_stats->disp_slots[i]);
+    }
+    fprintf(out, "},\n");
+    fprintf(out, "  \"issue_slots\": [\n");
+    for (int t = 0; t < 3; t++) {
+        fprintf(out, "    {\"fu_type\": %d, \"utilization\": %f", t, p_stats->fu_utilization[t]);
+        for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+            fprintf(out, ", \"%s\": %lu", issue_slot_names[i], p_stats->issue_slots[t][i]);
+        }
+        fprintf(out, "}%s\n", t < 2 ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"result_bus\": {\"utilization\": %f, \"broadcasts\": %lu, \"full_cycles\": %lu},\n",
+            p_stats->bus_utilization, p_stats->bus_broadcasts, p_stats->bus_full_cycles);
+    fprintf(out, "  \"threads\": [");
+    for (unsigned long t = 0; t < p_stats->num_threads; t++) {
+        fprintf(out, "%s{\"retired_instruction\": %lu, \"ipc\": %f}", t > 0 ? ", " : "",
+                p_stats->thread_retired[t], p_stats->thread_ipc[t]);
+    }
+    fprintf(out, "]%s\n", per_core != NULL ? "," : "");
+    if (per_core != NULL) {
+        fprintf(out, "  \"cores\": [");
+        for (size_t c = 0; c < per_core->size(); c++) {
+            const proc_stats_t& core = (*per_core)[c];
+            fprintf(out, "%s{\"cycles\": %lu, \"retired_instruction\": %lu, \"ipc\": %f}", c > 0 ? ", " : "",
+                    core.cycle_count, core.retired_instruction, core.avg_inst_retired);
+        }
+        fprintf(out, "]\n");
+    }
+    fprintf(out, "}\n");
+
+    if (!to_stdout) {
+        fclose(out);
+    }
+    return true;
 }
@@ -0,0 +1,353 @@
+#include "procsim_interval.hpp"
+#include "processor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+static const char* bottleneck_names[NUM_BOTTLENECKS] = { "fetch", "window", "k0", "k1", "k2", "bus" };
+
+// Exponents tried by the fit; the scale is solved for each
+static const double fit_exponents[] = { 1.0, 1.25, 1.5, 2.0, 3.0, 4.0, 6.0, 8.0, 12.0, 16.0, 32.0 };
+
+static int fu_type_of(const trace_bin_record_t& rec)
+{
+    int type = (rec.op_code == -1) ? 1 : rec.op_code;
+    return (type < 0 || type > 2) ? 1 : type;
+}
+
+void profile_trace(const std::vector<trace_dep_record_t>& trace, const fu_timing_t timing[3],
+                   trace_profile_t* profile)
+{
+    memset(profile, 0, sizeof(trace_profile_t));
+    size_t n = trace.size();
+    profile->instructions = n;
+    for (int t = 0; t < 3; t++) {
+        profile->occupancy[t] = timing[t].interval ? timing[t].interval : timing[t].latency;
+    }
+
+    // Op mix, distances and fan-out straight from the annotation
+    std::vector<uint32_t> consumers(n, 0);
+    uint64_t producers = 0;
+    uint64_t operands = 0;
+    double distance_sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        const trace_dep_record_t& rec = trace[i];
+        profile->op_mix[fu_type_of(rec.inst)]++;
+        if (rec.inst.dest_reg >= 0 && rec.inst.dest_reg < NUM_ARCH_REGS) {
+            producers++;
+        }
+        for (int s = 0; s < 2; s++) {
+            uint32_t d = rec.src_distance[s];
+            if (d == 0 || d > i) {
+                continue;
+            }
+            int bucket = 31 - __builtin_clz(d);
+            profile->distance[bucket < INTERVAL_DISTANCE_BUCKETS - 1 ? bucket : INTERVAL_DISTANCE_BUCKETS - 1]++;
+            distance_sum += d;
+            operands++;
+            consumers[i - d]++;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (trace[i].inst.dest_reg >= 0 && trace[i].inst.dest_reg < NUM_ARCH_REGS) {
+            uint32_t c = consumers[i];
+            profile->fanout[c < INTERVAL_FANOUT_BUCKETS - 1 ? c : INTERVAL_FANOUT_BUCKETS - 1]++;
+        }
+    }
+    profile->mean_distance = operands > 0 ? distance_sum / operands : 0.0;
+    profile->mean_fanout = producers > 0 ? (double)operands / producers : 0.0;
+
+    // K(W): longest chain inside each block of W instructions, producers outside the block
+    // counted as ready. The last partial block only counts when it is the only one.
+    std::vector<uint64_t> depth(n > 0 ? n : 1);
+    for (int w = 0; w < INTERVAL_WINDOWS; w++) {
+        size_t block = (size_t)1 << w;
+        double total = 0.0;
+        size_t blocks = 0;
+        for (size_t start = 0; start < n; start += block) {
+            size_t end = std::min(start + block, n);
+            if (end - start < block && blocks > 0) {
+                break;
+            }
+            uint64_t longest = 0;
+            for (size_t i = start; i < end; i++) {
+                uint64_t ready = 0;
+                for (int s = 0; s < 2; s++) {
+                    uint32_t d = trace[i].src_distance[s];
+                    if (d != 0 && d <= i - start && depth[i - d] > ready) {
+                        ready = depth[i - d];
+                    }
+                }
+                depth[i] = ready + timing[fu_type_of(trace[i].inst)].latency + 1;
+                longest = std::max(longest, depth[i]);
+            }
+            total += longest;
+            blocks++;
+        }
+        profile->critical_path[w] = blocks > 0 ? total / blocks : 0.0;
+    }
+}
+
+/**
+ * Cycles per instruction each resource alone allows
+ */
+static void resource_cpi(const trace_profile_t& profile, const sweep_config_t& config, uint64_t window,
+                         double cpi[NUM_BOTTLENECKS])
+{
+    double n = (double)profile.instructions;
+    const uint64_t k[3] = { config.k0, config.k1, config.k2 };
+
+    // K(W) between the profiled powers of two is interpolated on log2 W; beyond the
+    // largest block the window adds no more parallelism
+    double w = (double)(window > 0 ? window : 1);
+    double lw = std::log2(w);
+    double k_w;
+    if (lw >= INTERVAL_WINDOWS - 1) {
+        k_w = profile.critical_path[INTERVAL_WINDOWS - 1] * w / (double)((uint64_t)1 << (INTERVAL_WINDOWS - 1));
+    } else {
+        int lo = (int)lw;
+        double frac = lw - lo;
+        k_w = profile.critical_path[lo] + frac * (profile.critical_path[lo + 1] - profile.critical_path[lo]);
+    }
+
+    cpi[BOTTLENECK_FETCH] = config.f > 0 ? 1.0 / config.f : HUGE_VAL;
+    cpi[BOTTLENECK_WINDOW] = k_w / w;
+    for (int t = 0; t < 3; t++) {
+        double share = n > 0 ? profile.op_mix[t] / n : 0.0;
+        cpi[BOTTLENECK_K0 + t] = share == 0.0 ? 0.0 : (k[t] > 0 ? share * profile.occupancy[t] / k[t] : HUGE_VAL);
+    }
+    cpi[BOTTLENECK_BUS] = config.r > 0 ? 1.0 / config.r : HUGE_VAL;
+}
+
+static double combine(const double cpi[NUM_BOTTLENECKS], double exponent)
+{
+    double worst = 0.0;
+    for (int b = 0; b < NUM_BOTTLENECKS; b++) {
+        worst = std::max(worst, cpi[b]);
+    }
+    if (worst == 0.0 || std::isinf(worst)) {
+        return worst;
+    }
+    // Normalized by the worst term so large exponents do not overflow
+    double sum = 0.0;
+    for (int b = 0; b < NUM_BOTTLENECKS; b++) {
+        sum += std::pow(cpi[b] / worst, exponent);
+    }
+    return worst * std::pow(sum, 1.0 / exponent);
+}
+
+double predict_cycles(const trace_profile_t& profile, const interval_model_t& model,
+                      const sweep_config_t& config, uint64_t window, interval_bottleneck_t* bottleneck)
+{
+    double cpi[NUM_BOTTLENECKS];
+    resource_cpi(profile, config, window, cpi);
+    if (bottleneck != NULL) {
+        *bottleneck = (interval_bottleneck_t)(std::max_element(cpi, cpi + NUM_BOTTLENECKS) - cpi);
+    }
+    return model.scale * combine(cpi, model.exponent) * profile.instructions;
+}
+
+/**
+ * Fit the exponent and scale to the detailed runs other than skip (all of them if skip
+ * is out of range), minimizing the squared relative error; the best exponent has the
+ * lowest mean error
+ */
+static interval_model_t fit_model(const std::vector<std::vector<double> >& cpi_terms,
+                                  const std::vector<double>& detailed_cpi, size_t skip)
+{
+    interval_model_t best = { 1.0, 1.0 };
+    double best_error = HUGE_VAL;
+    for (double exponent : fit_exponents) {
+        // Relative error of scale * x / y: the least-squares scale is sum(x/y) / sum((x/y)^2)
+        double sum = 0.0;
+        double sum_sq = 0.0;
+        for (size_t i = 0; i < detailed_cpi.size(); i++) {
+            if (i == skip) {
+                continue;
+            }
+            double ratio = combine(cpi_terms[i].data(), exponent) / detailed_cpi[i];
+            sum += ratio;
+            sum_sq += ratio * ratio;
+        }
+        if (sum_sq == 0.0) {
+            continue;
+        }
+        double scale = sum / sum_sq;
+        double error = 0.0;
+        for (size_t i = 0; i < detailed_cpi.size(); i++) {
+            if (i != skip) {
+                error += std::fabs(scale * combine(cpi_terms[i].data(), exponent) / detailed_cpi[i] - 1.0);
+            }
+        }
+        if (error < best_error) {
+            best_error = error;
+            best.exponent = exponent;
+            best.scale = scale;
+        }
+    }
+    return best;
+}
+
+void run_interval_sweep(const std::vector<trace_dep_record_t>& trace,
+                        const std::vector<sweep_config_t>& configs, const Processor& prototype,
+                        const fu_timing_t timing[3], unsigned calibration, unsigned num_threads,
+                        FILE* out, FILE* report)
+{
+    trace_profile_t profile;
+    profile_trace(trace, timing, &profile);
+
+    // Detailed runs of configurations spread evenly over the list
+    if (calibration > configs.size()) {
+        calibration = configs.size();
+    }
+    std::vector<size_t> picked;
+    for (unsigned j = 0; j < calibration; j++) {
+        picked.push_back((size_t)((j + 0.5) * configs.size() / calibration));
+    }
+    std::vector<uint64_t> detailed(picked.size(), 0);
+    std::vector<char> stuck(picked.size(), 0);
+    std::atomic<size_t> next_run(0);
+    auto worker = [&]() {
+        for (;;) {
+            size_t j = next_run.fetch_add(1);
+            if (j >= picked.size()) {
+                return;
+            }
+            const sweep_config_t& config = configs[picked[j]];
+            Processor proc(prototype);
+            proc.set_source_span(trace.data(), trace.size());
+            proc.setup(config.r, config.k0, config.k1, config.k2, config.f);
+            proc_stats_t stats;
+            memset(&stats, 0, sizeof(proc_stats_t));
+            stuck[j] = !proc.run(&stats);
+            detailed[j] = stats.cycle_count;
+        }
+    };
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    if (num_threads > picked.size()) {
+        num_threads = picked.size();
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < num_threads; t++) {
+        pool.push_back(std::thread(worker));
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    // A run that got stuck has no cycle count to fit to
+    size_t kept = 0;
+    for (size_t j = 0; j < picked.size(); j++) {
+        if (!stuck[j]) {
+            picked[kept] = picked[j];
+            detailed[kept] = detailed[j];
+            kept++;
+        }
+    }
+    size_t dropped = picked.size() - kept;
+    picked.resize(kept);
+    detailed.resize(kept);
+
+    // Fit on every detailed run; the error is measured leave-one-out, so each run is
+    // predicted by a model that has not seen it
+    std::vector<std::vector<double> > cpi_terms(picked.size(), std::vector<double>(NUM_BOTTLENECKS));
+    std::vector<double> detailed_cpi(picked.size());
+    for (size_t j = 0; j < picked.size(); j++) {
+        const sweep_config_t& config = configs[picked[j]];
+        resource_cpi(profile, config, prototype.rs_entries(config.k0, config.k1, config.k2), cpi_terms[j].data());
+        detailed_cpi[j] = profile.instructions > 0 ? (double)detailed[j] / profile.instructions : 1.0;
+    }
+    interval_model_t model = fit_model(cpi_terms, detailed_cpi, picked.size());
+    double mean_error = 0.0;
+    double max_error = 0.0;
+    bool cross_validated = picked.size() >= 3;
+    for (size_t j = 0; j < picked.size(); j++) {
+        interval_model_t held_out = cross_validated ? fit_model(cpi_terms, detailed_cpi, j) : model;
+        double error = std::fabs(held_out.scale * combine(cpi_terms[j].data(), held_out.exponent) / detailed_cpi[j] - 1.0);
+        mean_error += error / picked.size();
+        max_error = std::max(max_error, error);
+    }
+
+    // Predict every configuration
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    std::vector<double> predicted(configs.size());
+    std::vector<interval_bottleneck_t> bottleneck(configs.size());
+    for (size_t i = 0; i < configs.size(); i++) {
+        const sweep_config_t& config = configs[i];
+        predicted[i] = predict_cycles(profile, model, config, prototype.rs_entries(config.k0, config.k1, config.k2),
+                                      &bottleneck[i]);
+    }
+    double predict_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // Near the front: no configuration with at most as much hardware is faster by more than
+    // the model can be wrong in both predictions
+    std::vector<uint64_t> cost(configs.size());
+    std::vector<size_t> by_cost(configs.size());
+    for (size_t i = 0; i < configs.size(); i++) {
+        cost[i] = configs[i].r + configs[i].k0 + configs[i].k1 + configs[i].k2 + configs[i].f;
+        by_cost[i] = i;
+    }
+    std::sort(by_cost.begin(), by_cost.end(), [&](size_t a, size_t b) { return cost[a] < cost[b]; });
+    std::vector<bool> near_front(configs.size());
+    double best = HUGE_VAL;
+    for (size_t g = 0; g < by_cost.size();) {
+        size_t end = g;
+        while (end < by_cost.size() && cost[by_cost[end]] == cost[by_cost[g]]) {
+            best = std::min(best, predicted[by_cost[end]]);
+            end++;
+        }
+        for (; g < end; g++) {
+            size_t i = by_cost[g];
+            near_front[i] = !(best * (1.0 + max_error) < predicted[i] * (1.0 - max_error));
+        }
+    }
+
+    fprintf(out, "R,k0,k1,k2,F,predicted_cycles,predicted_ipc,bottleneck,near_front,detailed_cycles\n");
+    std::vector<int64_t> detailed_of(configs.size(), -1);
+    for (size_t j = 0; j < picked.size(); j++) {
+        detailed_of[picked[j]] = (int64_t)detailed[j];
+    }
+    for (size_t i = 0; i < configs.size(); i++) {
+        const sweep_config_t& config = configs[i];
+        fprintf(out, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.0f,%f,%s,%d,",
+                config.r, config.k0, config.k1, config.k2, config.f, predicted[i],
+                predicted[i] > 0.0 ? profile.instructions / predicted[i] : 0.0,
+                bottleneck_names[bottleneck[i]], near_front[i] ? 1 : 0);
+        if (detailed_of[i] >= 0) {
+            fprintf(out, "%" PRId64, detailed_of[i]);
+        }
+        fprintf(out, "\n");
+    }
+
+    if (report == NULL) {
+        return;
+    }
+    uint64_t on_front = std::count(near_front.begin(), near_front.end(), true);
+    if (dropped > 0) {
+        fprintf(report, "Left out %zu detailed runs that stopped making progress\n", dropped);
+    }
+    fprintf(report, "Interval model: CPI = %.4f * (sum cpi_i^%g)^(1/%g), fitted to %zu detailed runs\n",
+            model.scale, model.exponent, model.exponent, picked.size());
+    fprintf(report, "Model error (%s): mean %.2f%%, max %.2f%%\n",
+            cross_validated ? "leave-one-out" : "in-sample, fewer than 3 runs", 100.0 * mean_error,
+            100.0 * max_error);
+    fprintf(report, "Predicted %zu configurations in %.1f us each; %" PRIu64 " near the front\n",
+            configs.size(), configs.empty() ? 0.0 : 1e6 * predict_time / configs.size(), on_front);
+    fprintf(report, "Trace profile: %" PRIu64 " instructions, op mix %.1f%% / %.1f%% / %.1f%%, "
+            "mean dependence distance %.1f, mean fan-out %.2f\n", profile.instructions,
+            profile.instructions ? 100.0 * profile.op_mix[0] / profile.instructions : 0.0,
+            profile.instructions ? 100.0 * profile.op_mix[1] / profile.instructions : 0.0,
+            profile.instructions ? 100.0 * profile.op_mix[2] / profile.instructions : 0.0,
+            profile.mean_distance, profile.mean_fanout);
+    fprintf(report, "Critical path K(W):");
+    for (int w = 0; w < INTERVAL_WINDOWS; w += 2) {
+        fprintf(report, " W=%lu %.1f", (unsigned long)1 << w, profile.critical_path[w]);
+    }
+    fprintf(report, "\n");
+}
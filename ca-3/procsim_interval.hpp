@@ -0,0 +1,82 @@
+#ifndef PROCSIM_INTERVAL_HPP
+#define PROCSIM_INTERVAL_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "procsim.hpp"
+#include "procsim_trace.hpp"
+#include "procsim_sweep.hpp"
+
+// Analytical interval model, a pre-filter for sweeps: the trace is profiled once (op mix,
+// dependence distances, producer fan-out and the critical path K(W) of W-instruction
+// blocks), and the cycles of any (R, k0, k1, k2, F) then follow in closed form from the
+// cycles per instruction each resource alone would allow:
+//   fetch 1/F, window K(W)/W (W = RS entries), FU type t mix_t * occupancy_t / k_t,
+//   result buses 1/R
+// combined as scale * (sum cpi_i^p)^(1/p). The exponent p and the scale are fitted to
+// detailed simulations of a few of the configurations.
+
+#define INTERVAL_WINDOWS 17                // K(W) profiled for W = 1, 2, 4, ..., 65536
+#define INTERVAL_DISTANCE_BUCKETS 21       // Dependence distances 1, 2-3, 4-7, ..., >= 2^20
+#define INTERVAL_FANOUT_BUCKETS 9          // Consumers per producer 0, 1, ..., >= 8
+#define DEFAULT_INTERVAL_CALIBRATION 8     // Detailed runs the model is fitted to
+
+typedef struct _trace_profile_t
+{
+    uint64_t instructions;
+    uint64_t op_mix[3];                              // Instructions per FU type
+    uint64_t occupancy[3];                           // Cycles an instruction holds its FU
+    uint64_t distance[INTERVAL_DISTANCE_BUCKETS];    // Source operands by producer distance
+    uint64_t fanout[INTERVAL_FANOUT_BUCKETS];        // Producers by number of consumers
+    double mean_distance;
+    double mean_fanout;                              // Consumers per instruction with a dest
+    double critical_path[INTERVAL_WINDOWS];          // K(2^i): mean longest chain per block, in cycles
+} trace_profile_t;
+
+typedef struct _interval_model_t
+{
+    double exponent;     // p of the combination (large = the worst bottleneck alone)
+    double scale;
+} interval_model_t;
+
+enum interval_bottleneck_t {
+    BOTTLENECK_FETCH,
+    BOTTLENECK_WINDOW,
+    BOTTLENECK_K0,
+    BOTTLENECK_K1,
+    BOTTLENECK_K2,
+    BOTTLENECK_BUS,
+    NUM_BOTTLENECKS
+};
+
+class Processor;
+
+/**
+ * One pass over the annotated trace. A dependent instruction can fire latency + 1 cycles
+ * after its producer did, which is what a chain costs in K(W).
+ */
+void profile_trace(const std::vector<trace_dep_record_t>& trace, const fu_timing_t timing[3],
+                   trace_profile_t* profile);
+
+/**
+ * Predicted cycles of one configuration
+ * @window RS entries of the configuration
+ * @bottleneck Set to the resource with the highest CPI (may be NULL)
+ */
+double predict_cycles(const trace_profile_t& profile, const interval_model_t& model,
+                      const sweep_config_t& config, uint64_t window, interval_bottleneck_t* bottleneck);
+
+/**
+ * Predict every configuration, fitting the model to detailed runs of `calibration` of them
+ * (spread over the list), and write one CSV row per configuration to out. A row is marked
+ * near_front unless a configuration with no more hardware (R + k0 + k1 + k2 + F) is faster
+ * beyond the model's error. The fit and its leave-one-out error go to report (if not NULL).
+ * A detailed run that gets stuck is left out of the fit.
+ */
+void run_interval_sweep(const std::vector<trace_dep_record_t>& trace,
+                        const std::vector<sweep_config_t>& configs, const Processor& prototype,
+                        const fu_timing_t timing[3], unsigned calibration, unsigned num_threads,
+                        FILE* out, FILE* report);
+
+#endif /* PROCSIM_INTERVAL_HPP */
@@ -0,0 +1,138 @@
+#include "procsim_multicore.hpp"
+#include "processor.hpp"
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Reusable barrier for the core threads. The last thread to arrive runs the completion
+// step (hook, termination check) before anyone is released, so the step sees every
+// core paused.
+class QuantumBarrier {
+public:
+    explicit QuantumBarrier(size_t parties) : parties(parties), waiting(0), generation(0) {}
+
+    template <typename Completion>
+    void arrive_and_wait(Completion completion)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t gen = generation;
+        if (++waiting == parties) {
+            completion();
+            waiting = 0;
+            generation++;
+            released.notify_all();
+            return;
+        }
+        released.wait(lock, [&]() { return generation != gen; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t parties;
+    size_t waiting;
+    uint64_t generation;
+};
+
+uint64_t run_multicore(const std::vector<Processor*>& cores, uint64_t quantum,
+                       quantum_hook_fn hook, void* hook_ctx)
+{
+    if (cores.empty()) {
+        return 0;
+    }
+    if (quantum == 0) {
+        quantum = DEFAULT_MULTICORE_QUANTUM;
+    }
+
+    QuantumBarrier barrier(cores.size());
+    uint64_t barriers = 0;
+    uint64_t cycle = 0;
+    bool finished = false;      // Written by the completion step only, read after release
+
+    // Runs with every core paused at the barrier
+    auto completion = [&]() {
+        barriers++;
+        cycle += quantum;
+        finished = true;
+        for (Processor* core : cores) {
+            finished = finished && core->done();
+        }
+        if (!finished && hook != NULL && !hook(hook_ctx, cores.data(), cores.size(), cycle)) {
+            finished = true;
+        }
+    };
+
+    auto worker = [&](Processor* core) {
+        for (;;) {
+            core->step(quantum);
+            barrier.arrive_and_wait(completion);
+            if (finished) {
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t c = 1; c < cores.size(); c++) {
+        pool.push_back(std::thread(worker, cores[c]));
+    }
+    worker(cores[0]);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    return barriers;
+}
+
+void aggregate_stats(const std::vector<proc_stats_t>& per_core, proc_stats_t* total)
+{
+    memset(total, 0, sizeof(proc_stats_t));
+    double fired = 0.0;
+    double disp_size = 0.0;
+    double bus_busy = 0.0;
+    unsigned long core_cycles = 0;
+    for (const proc_stats_t& core : per_core) {
+        if (core.cycle_count > total->cycle_count) {
+            total->cycle_count = core.cycle_count;
+        }
+        if (core.max_disp_size > total->max_disp_size) {
+            total->max_disp_size = core.max_disp_size;
+        }
+        total->retired_instruction += core.retired_instruction;
+        total->fetch_stall_cycles += core.fetch_stall_cycles;
+        total->disp_full_cycles += core.disp_full_cycles;
+        total->rob_full_cycles += core.rob_full_cycles;
+        total->prf_full_cycles += core.prf_full_cycles;
+        for (int t = 0; t < 3; t++) {
+            total->rs_full_cycles[t] += core.rs_full_cycles[t];
+            for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+                total->issue_slots[t][i] += core.issue_slots[t][i];
+            }
+        }
+        for (int i = 0; i < NUM_DISP_SLOTS; i++) {
+            total->disp_slots[i] += core.disp_slots[i];
+        }
+        total->bus_broadcasts += core.bus_broadcasts;
+        total->bus_full_cycles += core.bus_full_cycles;
+
+        // Rates back to totals, to be divided by the socket's cycles
+        fired += (double)core.avg_inst_fired * core.cycle_count;
+        disp_size += (double)core.avg_disp_size * core.cycle_count;
+        bus_busy += (double)core.bus_utilization * core.cycle_count;
+        core_cycles += core.cycle_count;
+    }
+
+    if (total->cycle_count > 0) {
+        total->avg_inst_retired = (float)total->retired_instruction / (float)total->cycle_count;
+        total->avg_inst_fired = (float)(fired / total->cycle_count);
+        total->avg_disp_size = (float)(disp_size / total->cycle_count);
+    }
+    for (int t = 0; t < 3; t++) {
+        unsigned long slots = 0;
+        for (int i = 0; i < NUM_ISSUE_SLOTS; i++) {
+            slots += total->issue_slots[t][i];
+        }
+        total->fu_utilization[t] = slots > 0 ? (float)total->issue_slots[t][ISSUE_SLOT_USED] / (float)slots : 0.0f;
+    }
+    total->bus_utilization = core_cycles > 0 ? (float)(bus_busy / core_cycles) : 0.0f;
+}
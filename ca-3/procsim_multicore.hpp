@@ -0,0 +1,41 @@
+#ifndef PROCSIM_MULTICORE_HPP
+#define PROCSIM_MULTICORE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "procsim.hpp"
+
+#define DEFAULT_MULTICORE_QUANTUM 1000   // Cycles each core runs between barriers
+
+// Multi-core simulation: N independent Processor instances (one per core, each with its
+// own trace) run on their own host threads. All cores stop at a barrier every quantum
+// cycles; there, with every core paused at the same simulated cycle, an optional hook can
+// model resources the cores share (a common result bus, a memory arbiter, ...).
+
+class Processor;
+
+// Called once per barrier on one host thread while every core is paused. cycle is the
+// simulated cycle all unfinished cores have reached. Returning false stops the run.
+typedef bool (*quantum_hook_fn)(void* ctx, Processor* const* cores, size_t num_cores, uint64_t cycle);
+
+/**
+ * Run every core (already set up, with its source) until all of them are done, each on
+ * its own host thread, synchronizing every quantum cycles. A core that finishes early
+ * keeps joining the barriers without simulating; a stuck core counts as done, so check
+ * Processor::stuck() afterwards.
+ * @quantum Cycles between barriers (0 = DEFAULT_MULTICORE_QUANTUM)
+ * @hook Shared-resource model run at each barrier (NULL = none)
+ * @return number of barriers passed
+ */
+uint64_t run_multicore(const std::vector<Processor*>& cores, uint64_t quantum,
+                       quantum_hook_fn hook, void* hook_ctx);
+
+/**
+ * Combine per-core statistics into socket-wide totals: the run takes as long as the
+ * slowest core, counts add up and the rates are per socket cycle (e.g. IPC is the
+ * summed throughput of all cores). Per-thread (SMT) fields are left empty.
+ */
+void aggregate_stats(const std::vector<proc_stats_t>& per_core, proc_stats_t* total);
+
+#endif /* PROCSIM_MULTICORE_HPP */
@@ -0,0 +1,84 @@
+#include "procsim_prefetch.hpp"
+
+TracePrefetcher::TracePrefetcher()
+    : source(NULL), head(0), tail(0), stop(false), pos(0), done(false)
+{
+}
+
+TracePrefetcher::~TracePrefetcher()
+{
+    stop.store(true, std::memory_order_relaxed);
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+void TracePrefetcher::start(source_fn source, size_t num_batches)
+{
+    this->source = source;
+    ring.resize(num_batches < 2 ? 2 : num_batches);
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    pos = 0;
+    done = false;
+    reader = std::thread(&TracePrefetcher::reader_loop, this);
+}
+
+void TracePrefetcher::reader_loop()
+{
+    size_t n = ring.size();
+    for (;;) {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        // Wait for a free slot (ring holds at most n - 1 published batches)
+        while ((h + 1) % n == tail.load(std::memory_order_acquire)) {
+            if (stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        Batch& batch = ring[h];
+        batch.count = 0;
+        while (batch.count < PREFETCH_BATCH_SIZE && source(&batch.inst[batch.count])) {
+            batch.count++;
+        }
+        bool last = batch.count < PREFETCH_BATCH_SIZE;
+
+        // Publish the batch
+        head.store((h + 1) % n, std::memory_order_release);
+        if (last) {
+            return;
+        }
+    }
+}
+
+bool TracePrefetcher::next(proc_inst_t* p_inst)
+{
+    if (done) {
+        return false;
+    }
+
+    size_t t = tail.load(std::memory_order_relaxed);
+
+    // Wait for the reader to publish the batch at tail
+    while (t == head.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    Batch& batch = ring[t];
+    if (pos == batch.count) {
+        // Only a short (final) batch can be exhausted without wrapping to the next one
+        done = true;
+        return false;
+    }
+
+    *p_inst = batch.inst[pos++];
+
+    // Hand a fully drained batch back to the reader
+    if (pos == PREFETCH_BATCH_SIZE) {
+        pos = 0;
+        tail.store((t + 1) % ring.size(), std::memory_order_release);
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef PROCSIM_PREFETCH_HPP
+#define PROCSIM_PREFETCH_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "procsim.hpp"
+
+#define DEFAULT_PREFETCH_BATCHES 64   // Ring size (batches) when prefetching is on
+#define PREFETCH_BATCH_SIZE 256       // Instructions per batch
+#define MAX_PREFETCH_BATCHES 4096     // Largest ring accepted by -p (about 100 MB of batches)
+
+// Asynchronous trace reader: a background thread pulls instructions from a source
+// function (fscanf/fread parsing) and publishes them in batches on a lock-free
+// single-producer/single-consumer ring, so the simulation thread never blocks on
+// I/O or spends time parsing. A batch shorter than PREFETCH_BATCH_SIZE marks the
+// end of the trace.
+class TracePrefetcher {
+public:
+    typedef bool (*source_fn)(proc_inst_t* p_inst);
+
+    TracePrefetcher();
+    ~TracePrefetcher();
+
+    /**
+     * Start the reader thread
+     * @source Function returning the next instruction, false at end of trace
+     * @num_batches Ring capacity in batches (at least 2)
+     */
+    void start(source_fn source, size_t num_batches);
+
+    /**
+     * Pop the next instruction (consumer side)
+     * @return false once the trace is exhausted
+     */
+    bool next(proc_inst_t* p_inst);
+
+private:
+    struct Batch {
+        proc_inst_t inst[PREFETCH_BATCH_SIZE];
+        size_t count;
+    };
+
+    void reader_loop();
+
+    source_fn source;
+    std::vector<Batch> ring;
+    std::thread reader;
+    std::atomic<size_t> head;      // Next batch the reader fills (written by reader only)
+    std::atomic<size_t> tail;      // Next batch the simulator drains (written by simulator only)
+    std::atomic<bool> stop;        // Asks the reader to exit early
+    size_t pos;                    // Position inside the batch at tail (simulator only)
+    bool done;                     // Simulator has seen the final batch
+};
+
+#endif /* PROCSIM_PREFETCH_HPP */
@@ -0,0 +1,104 @@
+#include "procsim_retire_log.hpp"
+
+RetireLog::RetireLog()
+    : out(NULL), mask(0), next_tag(1)
+{
+}
+
+void RetireLog::open(FILE* out, size_t window)
+{
+    this->out = out;
+    next_tag = 1;
+    this->window.clear();
+    if (out == NULL) {
+        return;
+    }
+    size_t size = 1;
+    while (size < window) {
+        size <<= 1;
+    }
+    Entry empty = { 0, 0, 0, 0, 0, 0 };
+    this->window.assign(size, empty);
+    mask = size - 1;
+    fprintf(out, "INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\n");
+}
+
+void RetireLog::write(const Entry& entry)
+{
+    fprintf(out, "%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+            entry.tag,
+            entry.fetch_cycle,
+            entry.dispatch_cycle,
+            entry.schedule_cycle,
+            entry.execute_cycle,
+            entry.state_update_cycle);
+}
+
+/**
+ * Enlarge the ring so that tags next_tag .. next_tag + span - 1 fit, keeping parked entries
+ */
+void RetireLog::grow(uint64_t span)
+{
+    size_t size = window.size();
+    while (size < span) {
+        size <<= 1;
+    }
+    Entry empty = { 0, 0, 0, 0, 0, 0 };
+    std::vector<Entry> larger(size, empty);
+    for (size_t i = 0; i < window.size(); i++) {
+        if (window[i].tag != 0) {
+            larger[window[i].tag & (size - 1)] = window[i];
+        }
+    }
+    window.swap(larger);
+    mask = size - 1;
+}
+
+void RetireLog::record(const proc_inst_t& inst)
+{
+    if (out == NULL) {
+        return;
+    }
+    Entry entry = { inst.tag, inst.fetch_cycle, inst.dispatch_cycle, inst.schedule_cycle,
+                    inst.execute_cycle, inst.state_update_cycle };
+    if (inst.tag != next_tag) {
+        // Older tags are still in flight: park it
+        if (inst.tag - next_tag >= window.size()) {
+            grow(inst.tag - next_tag + 1);
+        }
+        window[inst.tag & mask] = entry;
+        return;
+    }
+    write(entry);
+    next_tag++;
+
+    // Release the run of parked successors
+    for (;;) {
+        Entry& parked = window[next_tag & mask];
+        if (parked.tag != next_tag) {
+            break;
+        }
+        write(parked);
+        parked.tag = 0;
+        next_tag++;
+    }
+}
+
+void RetireLog::finish()
+{
+    if (out == NULL) {
+        return;
+    }
+    // Normally empty: every instruction has retired by the time the run completes
+    for (size_t i = 0; i < window.size(); i++) {
+        Entry& parked = window[next_tag & mask];
+        if (parked.tag == next_tag) {
+            write(parked);
+            parked.tag = 0;
+        }
+        next_tag++;
+    }
+    fprintf(out, "\n");
+    fflush(out);
+    out = NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef PROCSIM_RETIRE_LOG_HPP
+#define PROCSIM_RETIRE_LOG_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "procsim.hpp"
+
+// Streaming per-instruction timeline (INST FETCH DISP SCHED EXEC STATE, tab-separated).
+// Instructions can retire out of tag order, so each record is parked in a small reorder
+// window until every older tag has been written. The window is a power-of-two ring
+// indexed by tag; it starts at the RS size and doubles only if a retirement runs further
+// ahead of the oldest unwritten tag, so memory tracks the out-of-order span, not the
+// trace length.
+class RetireLog {
+public:
+    RetireLog();
+
+    /**
+     * Start a log on out (NULL disables logging) and write the header line
+     * @window Initial reorder window in instructions (rounded up to a power of two)
+     */
+    void open(FILE* out, size_t window);
+
+    bool enabled() const { return out != NULL; }
+
+    /**
+     * Log a retired instruction; written as soon as every older tag has been written
+     */
+    void record(const proc_inst_t& inst);
+
+    /**
+     * Write anything still parked in the window and the closing blank line, then stop
+     */
+    void finish();
+
+private:
+    struct Entry {
+        uint64_t tag;        // 0 = slot empty
+        uint64_t fetch_cycle;
+        uint64_t dispatch_cycle;
+        uint64_t schedule_cycle;
+        uint64_t execute_cycle;
+        uint64_t state_update_cycle;
+    };
+
+    void write(const Entry& entry);
+    void grow(uint64_t span);
+
+    FILE* out;
+    std::vector<Entry> window;    // Slot = tag & mask
+    uint64_t mask;
+    uint64_t next_tag;            // Next tag to write
+};
+
+#endif /* PROCSIM_RETIRE_LOG_HPP */
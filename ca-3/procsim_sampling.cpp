@@ -0,0 +1,119 @@
+#include "procsim_sampling.hpp"
+#include <cmath>
+#include <vector>
+
+// Hands a detailed window its instructions from the sampled source, up to a limit, and
+// keeps the trace position across windows
+struct SampleSource {
+    inst_source_fn source;
+    void* ctx;
+    uint64_t position;        // Instructions taken from the source so far
+    uint64_t window_limit;    // The current window may not read past this position
+    bool trace_done;
+};
+
+static bool next_instruction(SampleSource* in, proc_inst_t* p_inst)
+{
+    if (in->trace_done || !in->source(in->ctx, p_inst)) {
+        in->trace_done = true;
+        return false;
+    }
+    in->position++;
+    return true;
+}
+
+static bool window_source(void* ctx, proc_inst_t* p_inst)
+{
+    SampleSource* in = (SampleSource*)ctx;
+    return in->position < in->window_limit && next_instruction(in, p_inst);
+}
+
+bool run_sampled(const Processor& prototype, inst_source_fn source, void* ctx, uint64_t r, uint64_t k0,
+                 uint64_t k1, uint64_t k2, uint64_t f, const sample_config_t& config,
+                 sample_result_t* result)
+{
+    if (config.measure == 0 || config.warmup > config.period ||
+        config.measure > config.period - config.warmup) {
+        return false;
+    }
+
+    SampleSource in = { source, ctx, 0, 0, false };
+    std::vector<double> cpis;
+    uint64_t detailed = 0;
+    uint64_t unit_start = 0;
+    bool exact = false;
+    double exact_cycles = 0.0;
+
+    while (!in.trace_done) {
+        // Detailed window. It may fetch another warm-up's worth past the measured
+        // instructions, so they retire among younger instructions as in a full run. The
+        // limit saturates: warmup + measure fits, but another warmup or the offset may not.
+        uint64_t window_start = in.position;
+        uint64_t span = config.warmup + config.measure;
+        span = (span > UINT64_MAX - config.warmup) ? UINT64_MAX : span + config.warmup;
+        in.window_limit = (span > UINT64_MAX - window_start) ? UINT64_MAX : window_start + span;
+        Processor core(prototype);
+        core.set_source(window_source, &in);
+        core.setup(r, k0, k1, k2, f);
+
+        while (core.retired_count() < config.warmup && !core.done()) {
+            core.step(1);
+        }
+        uint64_t measure_start = core.cycle_count();
+        while (core.retired_count() < config.warmup + config.measure && !core.done()) {
+            core.step(1);
+        }
+        if (core.stuck()) {
+            return false;
+        }
+        if (core.retired_count() >= config.warmup + config.measure) {
+            cpis.push_back((double)(core.cycle_count() - measure_start) / (double)config.measure);
+        } else if (window_start == 0) {
+            // The whole trace fit in the first window: it was simulated in full
+            exact = true;
+            exact_cycles = (double)core.cycle_count();
+        }
+        detailed += in.position - window_start;
+
+        // Fast-forward to the next sampling unit. Windows start from an empty pipeline
+        // with every register ready, so no pipeline state needs carrying over: skipped
+        // instructions only advance the trace.
+        unit_start += config.period;
+        if (unit_start < in.position) {
+            unit_start = in.position;
+        }
+        proc_inst_t inst;
+        while (in.position < unit_start && next_instruction(&in, &inst)) {
+        }
+    }
+
+    result->samples = cpis.size();
+    result->total_instructions = in.position;
+    result->detailed_instructions = detailed;
+    result->cpi_mean = 0.0;
+    result->cpi_stddev = 0.0;
+    result->cpi_error = 0.0;
+    if (exact) {
+        result->cpi_mean = in.position > 0 ? exact_cycles / (double)in.position : 0.0;
+    } else if (!cpis.empty()) {
+        for (double cpi : cpis) {
+            result->cpi_mean += cpi;
+        }
+        result->cpi_mean /= cpis.size();
+        if (cpis.size() > 1) {
+            double sum_sq = 0.0;
+            for (double cpi : cpis) {
+                sum_sq += (cpi - result->cpi_mean) * (cpi - result->cpi_mean);
+            }
+            result->cpi_stddev = sqrt(sum_sq / (cpis.size() - 1));
+            result->cpi_error = SAMPLE_Z_95 * result->cpi_stddev / sqrt((double)cpis.size());
+        }
+    }
+
+    result->cycles = exact ? exact_cycles : result->cpi_mean * result->total_instructions;
+    result->cycles_error = result->cpi_error * result->total_instructions;
+    result->ipc = result->cpi_mean > 0.0 ? 1.0 / result->cpi_mean : 0.0;
+    result->ipc_low = result->cpi_mean > 0.0 ? 1.0 / (result->cpi_mean + result->cpi_error) : 0.0;
+    result->ipc_high = result->cpi_mean > result->cpi_error ? 1.0 / (result->cpi_mean - result->cpi_error) : INFINITY;
+    return true;
+}
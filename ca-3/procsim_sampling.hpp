@@ -0,0 +1,50 @@
+#ifndef PROCSIM_SAMPLING_HPP
+#define PROCSIM_SAMPLING_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include "procsim.hpp"
+#include "processor.hpp"
+
+// Sampled simulation (SMARTS-style systematic sampling): the trace is cut into sampling
+// units of `period` instructions. At the start of every unit a detailed window runs
+// `warmup` instructions to fill the pipeline and then measures the cycles per instruction
+// of the next `measure` instructions; the rest of the unit is fast-forwarded. The mean CPI
+// of the windows, times the instruction count of the whole trace, estimates its cycles.
+
+#define SAMPLE_Z_95 1.96     // Normal quantile of a two-sided 95% confidence interval
+
+typedef struct _sample_config_t
+{
+    uint64_t period;     // Instructions per sampling unit (one detailed window each)
+    uint64_t warmup;     // Detailed warm-up instructions before each measurement (not measured)
+    uint64_t measure;    // Measured instructions per window
+} sample_config_t;
+
+typedef struct _sample_result_t
+{
+    uint64_t samples;                // Windows measured
+    uint64_t total_instructions;     // Instructions in the trace
+    uint64_t detailed_instructions;  // Instructions fetched by detailed windows
+    double cpi_mean;                 // Mean CPI of the windows
+    double cpi_stddev;               // Sample standard deviation of the window CPIs
+    double cpi_error;                // Half-width of the 95% confidence interval of cpi_mean
+    double cycles;                   // Estimated cycles of the full trace
+    double cycles_error;             // Half-width of its 95% confidence interval
+    double ipc;                      // Estimated IPC, and its 95% confidence interval
+    double ipc_low;
+    double ipc_high;
+} sample_result_t;
+
+/**
+ * Estimate the cycles and IPC of a whole trace from sampled detailed windows. Every window
+ * is simulated on a fresh copy of prototype, so settings applied before setup() are kept.
+ * A trace no longer than one window is simulated in full (exact result, zero error).
+ * @return false if the configuration is invalid (measure = 0, or warmup + measure > period)
+ *         or a window's pipeline got stuck (see Processor::stuck)
+ */
+bool run_sampled(const Processor& prototype, inst_source_fn source, void* ctx, uint64_t r, uint64_t k0,
+                 uint64_t k1, uint64_t k2, uint64_t f, const sample_config_t& config,
+                 sample_result_t* result);
+
+#endif /* PROCSIM_SAMPLING_HPP */
@@ -0,0 +1,72 @@
+#include "procsim_segment.hpp"
+#include "processor.hpp"
+#include <atomic>
+#include <thread>
+
+uint64_t run_segmented(const std::vector<trace_dep_record_t>& trace, const Processor& prototype,
+                       uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f,
+                       uint64_t segments, uint64_t warmup, unsigned num_threads,
+                       std::vector<segment_result_t>& out)
+{
+    if (segments > trace.size()) {
+        segments = trace.size();
+    }
+    if (segments == 0) {
+        segments = 1;
+    }
+    out.assign(segments, segment_result_t());
+    for (uint64_t s = 0; s < segments; s++) {
+        segment_result_t& seg = out[s];
+        seg.start = trace.size() * s / segments;
+        seg.count = trace.size() * (s + 1) / segments - seg.start;
+        seg.warmup = (seg.start < warmup) ? seg.start : warmup;
+        seg.cycles = 0;
+        seg.stuck = false;
+    }
+
+    // Workers pull the next unsimulated segment until none are left
+    std::atomic<size_t> next_segment(0);
+    auto worker = [&]() {
+        for (;;) {
+            size_t s = next_segment.fetch_add(1);
+            if (s >= out.size()) {
+                return;
+            }
+            segment_result_t& seg = out[s];
+            Processor proc(prototype);
+            proc.set_source_span(trace.data() + seg.start - seg.warmup, seg.warmup + seg.count);
+            proc.setup(r, k0, k1, k2, f);
+
+            // The segment starts once as many instructions as the warm-up holds have retired
+            while (proc.retired_count() < seg.warmup && !proc.done()) {
+                proc.step(1);
+            }
+            uint64_t start_cycle = proc.cycle_count();
+            while (!proc.done()) {
+                proc.step(1u << 20);
+            }
+            seg.cycles = proc.cycle_count() - start_cycle;
+            seg.stuck = proc.stuck();
+        }
+    };
+
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    if (num_threads > out.size()) {
+        num_threads = out.size();
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < num_threads; t++) {
+        pool.push_back(std::thread(worker));
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    uint64_t cycles = 0;
+    for (const segment_result_t& seg : out) {
+        cycles += seg.cycles;
+    }
+    return cycles;
+}
@@ -0,0 +1,42 @@
+#ifndef PROCSIM_SEGMENT_HPP
+#define PROCSIM_SEGMENT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "procsim.hpp"
+#include "procsim_trace.hpp"
+
+#define DEFAULT_SEGMENT_WARMUP 10000   // Instructions replayed before each segment
+
+// Parallel segmented simulation: one trace (already in memory) is split into K segments
+// of consecutive instructions, each simulated concurrently on its own Processor. A segment
+// first replays a warm-up prefix of the instructions just before it, which refills the RS,
+// FUs and rename state, and is charged only the cycles after the prefix has retired. The
+// segment cycle counts then add up to an estimate for the whole trace.
+
+typedef struct _segment_result_t
+{
+    uint64_t start;       // First instruction of the segment
+    uint64_t count;       // Instructions in the segment
+    uint64_t warmup;      // Warm-up instructions replayed before it
+    uint64_t cycles;      // Cycles charged to the segment (after the warm-up retired)
+    bool stuck;           // The segment's pipeline stopped making progress (cycles then partial)
+} segment_result_t;
+
+class Processor;
+
+/**
+ * Simulate the trace in segments on num_threads host threads. Every segment runs on a copy
+ * of prototype, so settings applied before setup() are shared.
+ * @segments Number of segments (clamped to the instruction count)
+ * @warmup Warm-up instructions per segment (the first segment needs none)
+ * @out One result per segment, in trace order
+ * @return the stitched cycle count of the whole trace
+ */
+uint64_t run_segmented(const std::vector<trace_dep_record_t>& trace, const Processor& prototype,
+                       uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f,
+                       uint64_t segments, uint64_t warmup, unsigned num_threads,
+                       std::vector<segment_result_t>& out);
+
+#endif /* PROCSIM_SEGMENT_HPP */
@@ -0,0 +1,354 @@
+#include "procsim_simd.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PROCSIM_X86 1
+#endif
+
+/*
+ * Scalar reference kernels (always available)
+ */
+
+static void operands_ready_scalar(const uint64_t* p0, const uint64_t* p1, size_t n, uint64_t* out)
+{
+    size_t nwords = mask_words(n);
+    for (size_t w = 0; w < nwords; w++) {
+        uint64_t bits = 0;
+        size_t base = w * 64;
+        size_t end = (base + 64 < n) ? base + 64 : n;
+        for (size_t i = base; i < end; i++) {
+            bits |= (uint64_t)((p0[i] | p1[i]) == 0) << (i - base);
+        }
+        out[w] = bits;
+    }
+}
+
+static void wakeup_scalar(uint64_t* p0, uint64_t* p1, size_t n, uint64_t tag)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (p0[i] == tag) p0[i] = 0;
+        if (p1[i] == tag) p1[i] = 0;
+    }
+}
+
+static size_t find_tag_scalar(const uint64_t* tags, size_t n, uint64_t tag)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (tags[i] == tag) return i;
+    }
+    return n;
+}
+
+static void mask_select_scalar(const uint64_t* a, const uint64_t* b, const uint64_t* c,
+                               const uint64_t* d, size_t nwords, uint64_t* out)
+{
+    for (size_t w = 0; w < nwords; w++) {
+        out[w] = a[w] & (b[w] | c[w]) & ~d[w];
+    }
+}
+
+// Append count bits to the packed stream (words[*out_word], *out_bit); the stream never
+// overtakes the word being read, so the compaction can run in place
+static inline void mask_append(uint64_t* words, size_t* out_word, unsigned* out_bit, uint64_t* cur,
+                               uint64_t packed, unsigned count)
+{
+    *cur |= packed << *out_bit;
+    *out_bit += count;
+    if (*out_bit >= 64) {
+        words[(*out_word)++] = *cur;
+        *out_bit -= 64;
+        *cur = (*out_bit > 0) ? packed >> (count - *out_bit) : 0;
+    }
+}
+
+static inline void mask_compact_finish(uint64_t* words, size_t nwords, size_t out_word, unsigned out_bit,
+                                       uint64_t cur)
+{
+    if (out_bit > 0) {
+        words[out_word++] = cur;
+    }
+    for (; out_word < nwords; out_word++) {
+        words[out_word] = 0;
+    }
+}
+
+static void mask_compact_scalar(uint64_t* words, const uint64_t* remove, size_t nwords)
+{
+    size_t out_word = 0;
+    unsigned out_bit = 0;
+    uint64_t cur = 0;
+    for (size_t w = 0; w < nwords; w++) {
+        uint64_t keep = ~remove[w];
+        uint64_t bits = words[w] & keep;
+        uint64_t packed = 0;
+        while (bits != 0) {
+            int b = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            packed |= (uint64_t)1 << __builtin_popcountll(keep & (((uint64_t)1 << b) - 1));
+        }
+        mask_append(words, &out_word, &out_bit, &cur, packed, __builtin_popcountll(keep));
+    }
+    mask_compact_finish(words, nwords, out_word, out_bit, cur);
+}
+
+#ifdef PROCSIM_X86
+
+/*
+ * BMI2 kernel: pext packs the kept bits of a word in one instruction
+ */
+
+__attribute__((target("bmi2,popcnt")))
+static void mask_compact_bmi2(uint64_t* words, const uint64_t* remove, size_t nwords)
+{
+    size_t out_word = 0;
+    unsigned out_bit = 0;
+    uint64_t cur = 0;
+    for (size_t w = 0; w < nwords; w++) {
+        uint64_t keep = ~remove[w];
+        mask_append(words, &out_word, &out_bit, &cur, _pext_u64(words[w], keep), __builtin_popcountll(keep));
+    }
+    mask_compact_finish(words, nwords, out_word, out_bit, cur);
+}
+
+/*
+ * SSE4.1 kernels: 2 x uint64_t lanes (_mm_cmpeq_epi64 needs SSE4.1)
+ */
+
+__attribute__((target("sse4.1")))
+static void operands_ready_sse41(const uint64_t* p0, const uint64_t* p1, size_t n, uint64_t* out)
+{
+    size_t nwords = mask_words(n);
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t w = 0; w < nwords; w++) {
+        uint64_t bits = 0;
+        size_t base = w * 64;
+        size_t end = (base + 64 < n) ? base + 64 : n;
+        size_t i = base;
+        for (; i + 2 <= end; i += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(p0 + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(p1 + i));
+            __m128i eq = _mm_cmpeq_epi64(_mm_or_si128(a, b), zero);
+            bits |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << (i - base);
+        }
+        for (; i < end; i++) {
+            bits |= (uint64_t)((p0[i] | p1[i]) == 0) << (i - base);
+        }
+        out[w] = bits;
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void wakeup_sse41(uint64_t* p0, uint64_t* p1, size_t n, uint64_t tag)
+{
+    const __m128i t = _mm_set1_epi64x((long long)tag);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p1 + i));
+        _mm_storeu_si128((__m128i*)(p0 + i), _mm_andnot_si128(_mm_cmpeq_epi64(a, t), a));
+        _mm_storeu_si128((__m128i*)(p1 + i), _mm_andnot_si128(_mm_cmpeq_epi64(b, t), b));
+    }
+    wakeup_scalar(p0 + i, p1 + i, n - i, tag);
+}
+
+__attribute__((target("sse4.1")))
+static size_t find_tag_sse41(const uint64_t* tags, size_t n, uint64_t tag)
+{
+    const __m128i t = _mm_set1_epi64x((long long)tag);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i eq = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i*)(tags + i)), t);
+        int m = _mm_movemask_pd(_mm_castsi128_pd(eq));
+        if (m) return i + __builtin_ctz(m);
+    }
+    return i + find_tag_scalar(tags + i, n - i, tag);
+}
+
+__attribute__((target("sse4.1")))
+static void mask_select_sse41(const uint64_t* a, const uint64_t* b, const uint64_t* c,
+                              const uint64_t* d, size_t nwords, uint64_t* out)
+{
+    size_t w = 0;
+    for (; w + 2 <= nwords; w += 2) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + w));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + w));
+        __m128i vc = _mm_loadu_si128((const __m128i*)(c + w));
+        __m128i vd = _mm_loadu_si128((const __m128i*)(d + w));
+        __m128i r = _mm_andnot_si128(vd, _mm_and_si128(va, _mm_or_si128(vb, vc)));
+        _mm_storeu_si128((__m128i*)(out + w), r);
+    }
+    mask_select_scalar(a + w, b + w, c + w, d + w, nwords - w, out + w);
+}
+
+/*
+ * AVX2 kernels: 4 x uint64_t lanes
+ */
+
+__attribute__((target("avx2")))
+static void operands_ready_avx2(const uint64_t* p0, const uint64_t* p1, size_t n, uint64_t* out)
+{
+    size_t nwords = mask_words(n);
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t w = 0; w < nwords; w++) {
+        uint64_t bits = 0;
+        size_t base = w * 64;
+        size_t end = (base + 64 < n) ? base + 64 : n;
+        size_t i = base;
+        for (; i + 4 <= end; i += 4) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(p0 + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(p1 + i));
+            __m256i eq = _mm256_cmpeq_epi64(_mm256_or_si256(a, b), zero);
+            bits |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << (i - base);
+        }
+        for (; i < end; i++) {
+            bits |= (uint64_t)((p0[i] | p1[i]) == 0) << (i - base);
+        }
+        out[w] = bits;
+    }
+}
+
+__attribute__((target("avx2")))
+static void wakeup_avx2(uint64_t* p0, uint64_t* p1, size_t n, uint64_t tag)
+{
+    const __m256i t = _mm256_set1_epi64x((long long)tag);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p1 + i));
+        _mm256_storeu_si256((__m256i*)(p0 + i), _mm256_andnot_si256(_mm256_cmpeq_epi64(a, t), a));
+        _mm256_storeu_si256((__m256i*)(p1 + i), _mm256_andnot_si256(_mm256_cmpeq_epi64(b, t), b));
+    }
+    wakeup_scalar(p0 + i, p1 + i, n - i, tag);
+}
+
+__attribute__((target("avx2")))
+static size_t find_tag_avx2(const uint64_t* tags, size_t n, uint64_t tag)
+{
+    const __m256i t = _mm256_set1_epi64x((long long)tag);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(tags + i)), t);
+        int m = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (m) return i + __builtin_ctz(m);
+    }
+    return i + find_tag_scalar(tags + i, n - i, tag);
+}
+
+__attribute__((target("avx2")))
+static void mask_select_avx2(const uint64_t* a, const uint64_t* b, const uint64_t* c,
+                             const uint64_t* d, size_t nwords, uint64_t* out)
+{
+    size_t w = 0;
+    for (; w + 4 <= nwords; w += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + w));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + w));
+        __m256i vc = _mm256_loadu_si256((const __m256i*)(c + w));
+        __m256i vd = _mm256_loadu_si256((const __m256i*)(d + w));
+        __m256i r = _mm256_andnot_si256(vd, _mm256_and_si256(va, _mm256_or_si256(vb, vc)));
+        _mm256_storeu_si256((__m256i*)(out + w), r);
+    }
+    mask_select_scalar(a + w, b + w, c + w, d + w, nwords - w, out + w);
+}
+
+#endif /* PROCSIM_X86 */
+
+/*
+ * Runtime dispatch
+ */
+
+static void (*operands_ready_impl)(const uint64_t*, const uint64_t*, size_t, uint64_t*) = operands_ready_scalar;
+static void (*wakeup_impl)(uint64_t*, uint64_t*, size_t, uint64_t) = wakeup_scalar;
+static size_t (*find_tag_impl)(const uint64_t*, size_t, uint64_t) = find_tag_scalar;
+static void (*mask_select_impl)(const uint64_t*, const uint64_t*, const uint64_t*,
+                                const uint64_t*, size_t, uint64_t*) = mask_select_scalar;
+static void (*mask_compact_impl)(uint64_t*, const uint64_t*, size_t) = mask_compact_scalar;
+
+const char* simd_level_name(simd_level_t level)
+{
+    switch (level) {
+    case SIMD_AVX2:  return "avx2";
+    case SIMD_SSE41: return "sse4.1";
+    default:         return "scalar";
+    }
+}
+
+static simd_level_t simd_detect()
+{
+    simd_level_t level = SIMD_SCALAR;
+#ifdef PROCSIM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        level = SIMD_AVX2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        level = SIMD_SSE41;
+    }
+#endif
+
+    // Optional cap for testing the narrower paths
+    const char* cap = getenv("PROCSIM_SIMD");
+    if (cap != NULL) {
+        if (strcmp(cap, "scalar") == 0) {
+            level = SIMD_SCALAR;
+        } else if (strcmp(cap, "sse4.1") == 0 && level > SIMD_SSE41) {
+            level = SIMD_SSE41;
+        }
+    }
+
+    operands_ready_impl = operands_ready_scalar;
+    wakeup_impl = wakeup_scalar;
+    find_tag_impl = find_tag_scalar;
+    mask_select_impl = mask_select_scalar;
+    mask_compact_impl = mask_compact_scalar;
+#ifdef PROCSIM_X86
+    if (level == SIMD_AVX2) {
+        operands_ready_impl = operands_ready_avx2;
+        wakeup_impl = wakeup_avx2;
+        find_tag_impl = find_tag_avx2;
+        mask_select_impl = mask_select_avx2;
+        if (__builtin_cpu_supports("bmi2")) {
+            mask_compact_impl = mask_compact_bmi2;
+        }
+    } else if (level == SIMD_SSE41) {
+        operands_ready_impl = operands_ready_sse41;
+        wakeup_impl = wakeup_sse41;
+        find_tag_impl = find_tag_sse41;
+        mask_select_impl = mask_select_sse41;
+    }
+#endif
+    return level;
+}
+
+simd_level_t simd_init()
+{
+    // Detect once; every Processor calls this from setup, possibly on several threads
+    static simd_level_t level = simd_detect();
+    return level;
+}
+
+void simd_operands_ready(const uint64_t* p0, const uint64_t* p1, size_t n, uint64_t* out)
+{
+    operands_ready_impl(p0, p1, n, out);
+}
+
+void simd_wakeup(uint64_t* p0, uint64_t* p1, size_t n, uint64_t tag)
+{
+    wakeup_impl(p0, p1, n, tag);
+}
+
+size_t simd_find_tag(const uint64_t* tags, size_t n, uint64_t tag)
+{
+    return find_tag_impl(tags, n, tag);
+}
+
+void simd_mask_select(const uint64_t* a, const uint64_t* b, const uint64_t* c,
+                      const uint64_t* d, size_t nwords, uint64_t* out)
+{
+    mask_select_impl(a, b, c, d, nwords, out);
+}
+
+void simd_mask_compact(uint64_t* words, const uint64_t* remove, size_t nwords)
+{
+    mask_compact_impl(words, remove, nwords);
+}
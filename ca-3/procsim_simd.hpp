@@ -0,0 +1,67 @@
+#ifndef PROCSIM_SIMD_HPP
+#define PROCSIM_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// SIMD kernels for the reservation station scans. The RS keeps its hot fields in
+// columns (producer tags as uint64_t lanes, status flags as bitmask words with bit i
+// describing RS entry i), so each scan is a straight-line pass over packed data.
+// Every kernel has a scalar fallback; the widest implementation the host supports is
+// picked at runtime by simd_init().
+
+enum simd_level_t {
+    SIMD_SCALAR = 0,
+    SIMD_SSE41  = 1,
+    SIMD_AVX2   = 2
+};
+
+// Number of 64-bit mask words needed to hold n bits
+inline size_t mask_words(size_t n) { return (n + 63) / 64; }
+
+inline bool mask_test(const uint64_t* words, size_t i) { return (words[i >> 6] >> (i & 63)) & 1; }
+inline void mask_set(uint64_t* words, size_t i)        { words[i >> 6] |= (uint64_t)1 << (i & 63); }
+inline void mask_clear(uint64_t* words, size_t i)      { words[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+
+/**
+ * Select the best kernel set supported by this CPU; detection runs once per process.
+ * The PROCSIM_SIMD environment variable ("scalar", "sse4.1" or "avx2") can cap the
+ * level, e.g. to compare paths.
+ * @return the level in use
+ */
+simd_level_t simd_init();
+const char* simd_level_name(simd_level_t level);
+
+/**
+ * Readiness: bit i of out = (p0[i] | p1[i]) == 0, i.e. neither source operand
+ * is still waiting on a producer tag. Bits at or above n are cleared.
+ */
+void simd_operands_ready(const uint64_t* p0, const uint64_t* p1, size_t n, uint64_t* out);
+
+/**
+ * Wakeup: zero every producer lane in p0/p1 that equals tag (tag != 0), marking that
+ * operand as available once its producer broadcasts on a result bus.
+ */
+void simd_wakeup(uint64_t* p0, uint64_t* p1, size_t n, uint64_t tag);
+
+/**
+ * @return index of the first lane of tags equal to tag, or n if absent
+ */
+size_t simd_find_tag(const uint64_t* tags, size_t n, uint64_t tag);
+
+/**
+ * Mask combine over nwords words: out = a & (b | c) & ~d.
+ * Used both for fire candidates (ready & type & ~fired) and retire candidates
+ * (completed & (broadcast | granted)).
+ */
+void simd_mask_select(const uint64_t* a, const uint64_t* b, const uint64_t* c,
+                      const uint64_t* d, size_t nwords, uint64_t* out);
+
+/**
+ * Mask compaction over nwords words, in place: drop every bit whose remove bit is set and
+ * pack the rest towards bit 0 in order (the bitmask side of removing RS entries). The
+ * words freed at the top are cleared. Uses BMI2 pext where the host has it.
+ */
+void simd_mask_compact(uint64_t* words, const uint64_t* remove, size_t nwords);
+
+#endif /* PROCSIM_SIMD_HPP */
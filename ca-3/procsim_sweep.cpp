@@ -0,0 +1,257 @@
+#include "procsim_sweep.hpp"
+#include "processor.hpp"
+#include "procsim_cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+bool parse_count_prefix(const char* spec, uint64_t lo, uint64_t hi, uint64_t* out, const char** end)
+{
+    const char* p = spec;
+    uint64_t value = 0;
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    for (; *p >= '0' && *p <= '9'; p++) {
+        uint64_t digit = *p - '0';
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    if (value < lo || value > hi) {
+        return false;
+    }
+    *out = value;
+    *end = p;
+    return true;
+}
+
+bool parse_count(const char* spec, uint64_t lo, uint64_t hi, uint64_t* out)
+{
+    const char* end;
+    uint64_t value;
+    if (!parse_count_prefix(spec, lo, hi, &value, &end) || *end != '\0') {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+bool parse_count_list(const char* spec, int n, uint64_t lo, uint64_t hi, uint64_t* out)
+{
+    const char* p = spec;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && *p++ != ',') {
+            return false;
+        }
+        if (!parse_count_prefix(p, lo, hi, &out[i], &p)) {
+            return false;
+        }
+    }
+    return *p == '\0';
+}
+
+bool parse_sweep_values(const char* spec, std::vector<uint64_t>& out)
+{
+    const char* p = spec;
+    while (*p != '\0') {
+        uint64_t lo;
+        if (!parse_count_prefix(p, 1, MAX_SWEEP_PARAM, &lo, &p)) {
+            return false;
+        }
+        uint64_t hi = lo;
+        uint64_t step = 1;
+        if (*p == '-') {
+            if (!parse_count_prefix(p + 1, lo, MAX_SWEEP_PARAM, &hi, &p)) {
+                return false;
+            }
+            if (*p == ':' && !parse_count_prefix(p + 1, 1, MAX_SWEEP_PARAM, &step, &p)) {
+                return false;
+            }
+        }
+        if ((hi - lo) / step + 1 > MAX_SWEEP_CONFIGS - out.size()) {
+            return false;
+        }
+        // Stop before v + step could pass hi (or wrap)
+        for (uint64_t v = lo;; v += step) {
+            out.push_back(v);
+            if (v > hi - step) {
+                break;
+            }
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+    return !out.empty();
+}
+
+void expand_sweep_configs(const std::vector<uint64_t>& r, const std::vector<uint64_t>& k0,
+                          const std::vector<uint64_t>& k1, const std::vector<uint64_t>& k2,
+                          const std::vector<uint64_t>& f, std::vector<sweep_config_t>& out)
+{
+    for (uint64_t vr : r)
+        for (uint64_t v0 : k0)
+            for (uint64_t v1 : k1)
+                for (uint64_t v2 : k2)
+                    for (uint64_t vf : f) {
+                        sweep_config_t config = { vr, v0, v1, v2, vf };
+                        out.push_back(config);
+                    }
+}
+
+bool load_sweep_configs(const char* path, std::vector<sweep_config_t>& out)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", path);
+        return false;
+    }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        uint64_t values[5];
+        int n = 0;
+        for (char* field = strtok(line, " \t\r\n"); field != NULL; field = strtok(NULL, " \t\r\n")) {
+            if (n == 5 || !parse_count(field, 1, MAX_SWEEP_PARAM, &values[n])) {
+                n = -1;
+                break;
+            }
+            n++;
+        }
+        if (n == 5 && out.size() >= MAX_SWEEP_CONFIGS) {
+            fprintf(stderr, "%s:%d: more than %d configurations\n", path, line_no, MAX_SWEEP_CONFIGS);
+            fclose(file);
+            return false;
+        } else if (n == 5) {
+            sweep_config_t config = { values[0], values[1], values[2], values[3], values[4] };
+            out.push_back(config);
+        } else if (n != 0) {
+            fprintf(stderr, "%s:%d: expected \"R k0 k1 k2 F\"\n", path, line_no);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+bool load_trace(std::vector<trace_dep_record_t>& trace)
+{
+    proc_inst_t inst;
+    trace_dep_record_t rec;
+    TraceDepAnnotator annotator;
+    while (read_instruction(&inst)) {
+        annotator.annotate(&inst, rec.src_distance);
+        if (!trace_bin_encode(&inst, &rec.inst)) {
+            fprintf(stderr, "Instruction %zu has a field out of range for the sweep trace buffer\n",
+                    trace.size() + 1);
+            return false;
+        }
+        trace.push_back(rec);
+    }
+    return true;
+}
+
+uint64_t run_sweep(const std::vector<trace_dep_record_t>& trace,
+                   const std::vector<sweep_config_t>& configs, const Processor& prototype,
+                   unsigned num_threads, FILE* out, ResultCache* cache)
+{
+    std::vector<proc_stats_t> results(configs.size());
+    std::vector<char> stuck(configs.size(), 0);     // Written by the worker of that config only
+    std::vector<cache_key_t> keys(configs.size());
+    std::vector<size_t> todo;
+
+    // Cached configurations are answered up front, the rest are simulated
+    uint64_t trace_hash = cache ? trace_content_hash(trace.data(), trace.size()) : 0;
+    uint64_t settings_hash = cache ? prototype.settings_hash() : 0;
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (cache != NULL) {
+            cache_key_t& key = keys[i];
+            key.trace_hash = trace_hash;
+            key.trace_length = trace.size();
+            key.settings_hash = settings_hash;
+            key.r = configs[i].r;
+            key.k0 = configs[i].k0;
+            key.k1 = configs[i].k1;
+            key.k2 = configs[i].k2;
+            key.f = configs[i].f;
+            if (cache->lookup(key, &results[i])) {
+                continue;
+            }
+        }
+        todo.push_back(i);
+    }
+    std::atomic<size_t> next_config(0);
+
+    // Workers pull the next unsimulated configuration until none are left
+    auto worker = [&]() {
+        for (;;) {
+            size_t next = next_config.fetch_add(1);
+            if (next >= todo.size()) {
+                return;
+            }
+            size_t i = todo[next];
+            const sweep_config_t& config = configs[i];
+            Processor proc(prototype);
+            proc.set_source_span(trace.data(), trace.size());
+            proc.setup(config.r, config.k0, config.k1, config.k2, config.f);
+
+            proc_stats_t& stats = results[i];
+            memset(&stats, 0, sizeof(proc_stats_t));
+            stuck[i] = !proc.run(&stats);
+            proc.complete(&stats);
+        }
+    };
+
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    if (num_threads > todo.size()) {
+        num_threads = todo.size();
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < num_threads; t++) {
+        pool.push_back(std::thread(worker));
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    if (cache != NULL) {
+        for (size_t i : todo) {
+            if (!stuck[i]) {
+                cache->insert(keys[i], results[i]);
+            }
+        }
+        if (!cache->flush()) {
+            fprintf(stderr, "Failed to update the result cache\n");
+        }
+    }
+
+    fprintf(out, "R,k0,k1,k2,F,cycles,ipc,avg_inst_fired,avg_disp_size,max_disp_size,retired_instruction,fetch_stall_cycles,"
+                 "util_k0,util_k1,util_k2,bus_util,status\n");
+    for (size_t i = 0; i < configs.size(); i++) {
+        const sweep_config_t& config = configs[i];
+        const proc_stats_t& stats = results[i];
+        fprintf(out, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%lu,%f,%f,%f,%lu,%lu,%lu,%f,%f,%f,%f,%s\n",
+                config.r, config.k0, config.k1, config.k2, config.f,
+                stats.cycle_count, stats.avg_inst_retired, stats.avg_inst_fired,
+                stats.avg_disp_size, stats.max_disp_size, stats.retired_instruction,
+                stats.fetch_stall_cycles, stats.fu_utilization[0], stats.fu_utilization[1],
+                stats.fu_utilization[2], stats.bus_utilization, stuck[i] ? "stuck" : "ok");
+    }
+    return std::count(stuck.begin(), stuck.end(), 1);
+}
@@ -0,0 +1,89 @@
+#ifndef PROCSIM_SWEEP_HPP
+#define PROCSIM_SWEEP_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "procsim.hpp"
+#include "procsim_trace.hpp"
+
+// Design-space sweep: the trace is loaded once into a shared read-only buffer of
+// compact records and every configuration is simulated on its own Processor
+// instance, spread over a pool of host threads.
+
+#define MAX_SWEEP_THREADS 1024     // Largest worker pool accepted by -t
+#define MAX_SWEEP_PARAM 65536      // Largest R, k0, k1, k2 or F a sweep accepts
+#define MAX_SWEEP_CONFIGS (1 << 20)   // Largest configuration list a sweep expands to
+
+typedef struct _sweep_config_t
+{
+    uint64_t r;
+    uint64_t k0;
+    uint64_t k1;
+    uint64_t k2;
+    uint64_t f;
+} sweep_config_t;
+
+/**
+ * Strict decimal parsing shared by the option parsers: digits only (no sign or blanks),
+ * no overflow, and the value in [lo, hi]. parse_count_prefix stops at the first
+ * non-digit and returns its position in *end; parse_count requires the whole string.
+ * @return false on anything else
+ */
+bool parse_count_prefix(const char* spec, uint64_t lo, uint64_t hi, uint64_t* out, const char** end);
+bool parse_count(const char* spec, uint64_t lo, uint64_t hi, uint64_t* out);
+
+/**
+ * Parse "a,b,c": exactly n comma-separated counts, each in [lo, hi]
+ * @return false on a malformed list
+ */
+bool parse_count_list(const char* spec, int n, uint64_t lo, uint64_t hi, uint64_t* out);
+
+/**
+ * Parse a parameter list such as "4", "1,2,4", "1-8" or "2-16:2" (lo-hi:step),
+ * appending the values to out. Every value is in [1, MAX_SWEEP_PARAM], a range needs
+ * lo <= hi and step >= 1, and the list holds at most MAX_SWEEP_CONFIGS values.
+ * @return false on a malformed spec
+ */
+bool parse_sweep_values(const char* spec, std::vector<uint64_t>& out);
+
+/**
+ * Cartesian product of the per-parameter value lists
+ */
+void expand_sweep_configs(const std::vector<uint64_t>& r, const std::vector<uint64_t>& k0,
+                          const std::vector<uint64_t>& k1, const std::vector<uint64_t>& k2,
+                          const std::vector<uint64_t>& f, std::vector<sweep_config_t>& out);
+
+/**
+ * Read a config list, one "R k0 k1 k2 F" line per configuration ('#' starts a comment),
+ * each value in [1, MAX_SWEEP_PARAM], at most MAX_SWEEP_CONFIGS lines
+ * @return false if the file cannot be read or a line is malformed
+ */
+bool load_sweep_configs(const char* path, std::vector<sweep_config_t>& out);
+
+/**
+ * Load the whole trace through read_instruction() into compact records, annotated with
+ * their producer distances so that no configuration repeats the dependence analysis
+ * @return false if an instruction does not fit the compact record encoding
+ */
+bool load_trace(std::vector<trace_dep_record_t>& trace);
+
+class Processor;
+class ResultCache;
+
+/**
+ * Simulate every configuration over the shared trace on num_threads threads and write one
+ * CSV row per configuration (in config order) to out. Each run starts from a copy of
+ * prototype, so settings applied before setup() (FU timing, dispatch capacity, ...) are
+ * shared by all configurations.
+ * A configuration whose pipeline gets stuck does not stop the others: its row carries the
+ * statistics up to that point and the status "stuck" (otherwise "ok").
+ * @cache Opened result cache: configurations found there are not simulated, and the new
+ *        results are appended to it (NULL = no cache); stuck runs are not stored
+ * @return number of configurations that got stuck
+ */
+uint64_t run_sweep(const std::vector<trace_dep_record_t>& trace,
+               const std::vector<sweep_config_t>& configs, const Processor& prototype,
+               unsigned num_threads, FILE* out, ResultCache* cache = NULL);
+
+#endif /* PROCSIM_SWEEP_HPP */
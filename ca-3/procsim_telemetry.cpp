@@ -0,0 +1,201 @@
+#include "procsim_telemetry.hpp"
+#include <cstdarg>
+#include <cstring>
+
+#define WRITER_BUFFER (64 * 1024)   // Bytes formatted before each write
+#define WRITER_ROW_MAX 512          // Longest single printf
+
+// Trace-event process ids of the three track groups
+#define TRACE_PID_INSTRUCTIONS 1
+#define TRACE_PID_FUS 2
+#define TRACE_PID_BUSES 3
+
+/*
+ * BufferedWriter
+ */
+
+BufferedWriter::BufferedWriter()
+    : out(NULL), used(0)
+{
+}
+
+void BufferedWriter::open(FILE* out)
+{
+    this->out = out;
+    used = 0;
+    if (out == NULL) {
+        buffer.clear();
+    } else {
+        buffer.resize(WRITER_BUFFER);
+    }
+}
+
+void BufferedWriter::printf(const char* format, ...)
+{
+    if (out == NULL) {
+        return;
+    }
+    if (buffer.size() - used < WRITER_ROW_MAX) {
+        flush();
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer.data() + used, buffer.size() - used, format, args);
+    va_end(args);
+    if (n > 0) {
+        used += ((size_t)n < buffer.size() - used) ? (size_t)n : buffer.size() - used - 1;
+    }
+}
+
+void BufferedWriter::flush()
+{
+    fwrite(buffer.data(), 1, used, out);
+    used = 0;
+}
+
+void BufferedWriter::close()
+{
+    if (out == NULL) {
+        return;
+    }
+    flush();
+    fflush(out);
+    out = NULL;
+}
+
+/*
+ * IntervalLog
+ */
+
+IntervalLog::IntervalLog()
+    : interval(0), num_buses(0)
+{
+    memset(&last, 0, sizeof(last));
+}
+
+void IntervalLog::open(FILE* out, uint64_t interval, uint64_t num_buses)
+{
+    writer.open((interval > 0) ? out : NULL);
+    this->interval = interval;
+    this->num_buses = num_buses;
+    memset(&last, 0, sizeof(last));
+    writer.printf("cycle_start,cycle_end,retired,ipc,fire_rate,avg_rs_occupancy,avg_disp_size,bus_util\n");
+}
+
+void IntervalLog::sample(const interval_totals_t& totals)
+{
+    if (!enabled() || totals.cycle <= last.cycle) {
+        return;
+    }
+    double cycles = (double)(totals.cycle - last.cycle);
+    uint64_t retired = totals.retired - last.retired;
+    double bus_slots = cycles * (double)num_buses;
+    writer.printf("%lu,%lu,%lu,%f,%f,%f,%f,%f\n",
+                  last.cycle + 1, totals.cycle, retired,
+                  retired / cycles,
+                  (totals.fired - last.fired) / cycles,
+                  (totals.rs_size_sum - last.rs_size_sum) / cycles,
+                  (totals.disp_size_sum - last.disp_size_sum) / cycles,
+                  bus_slots > 0 ? (totals.bus_broadcasts - last.bus_broadcasts) / bus_slots : 0.0);
+    last = totals;
+}
+
+void IntervalLog::finish(const interval_totals_t& totals)
+{
+    sample(totals);
+    writer.close();
+}
+
+/*
+ * PipelineTrace
+ */
+
+PipelineTrace::PipelineTrace()
+    : last_granted(0), last_waiting(0)
+{
+    memset(fu_interval, 0, sizeof(fu_interval));
+}
+
+void PipelineTrace::open(FILE* out, const uint64_t num_fus[3], const fu_timing_t fu_timing[3])
+{
+    writer.open(out);
+    last_granted = 0;
+    last_waiting = 0;
+    for (int t = 0; t < 3; t++) {
+        fu_interval[t] = fu_timing[t].interval;
+    }
+
+    // Track names; every later event is preceded by a comma
+    writer.printf("[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Instructions\"}}",
+                  TRACE_PID_INSTRUCTIONS);
+    writer.printf(",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Function units\"}}",
+                  TRACE_PID_FUS);
+    writer.printf(",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Result buses\"}}",
+                  TRACE_PID_BUSES);
+    for (int t = 0; t < 3; t++) {
+        for (uint64_t i = 0; i < num_fus[t]; i++) {
+            writer.printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,\"args\":{\"name\":\"k%d.%lu\"}}",
+                          TRACE_PID_FUS, t * 1000000 + i, t, i);
+        }
+    }
+}
+
+void PipelineTrace::stage(uint64_t tag, const char* name, uint64_t begin, uint64_t end)
+{
+    if (end <= begin) {
+        return;  // Stage passed through within the cycle
+    }
+    writer.printf(",\n{\"name\":\"%s\",\"cat\":\"inst\",\"ph\":\"b\",\"id\":%lu,\"pid\":%d,\"ts\":%lu}"
+                  ",\n{\"name\":\"%s\",\"cat\":\"inst\",\"ph\":\"e\",\"id\":%lu,\"pid\":%d,\"ts\":%lu}",
+                  name, tag, TRACE_PID_INSTRUCTIONS, begin, name, tag, TRACE_PID_INSTRUCTIONS, end);
+}
+
+void PipelineTrace::record(const proc_inst_t& inst)
+{
+    if (!enabled()) {
+        return;
+    }
+    uint64_t end = inst.state_update_cycle + 1;
+
+    // Whole lifetime, with the stages nested inside it
+    writer.printf(",\n{\"name\":\"%lu\",\"cat\":\"inst\",\"ph\":\"b\",\"id\":%lu,\"pid\":%d,\"ts\":%lu,"
+                  "\"args\":{\"address\":\"0x%x\",\"op\":%d,\"dest\":%d,\"src\":[%d,%d]}}",
+                  inst.tag, inst.tag, TRACE_PID_INSTRUCTIONS, inst.fetch_cycle, inst.instruction_address,
+                  inst.op_code, inst.dest_reg, inst.src_reg[0], inst.src_reg[1]);
+    stage(inst.tag, "FETCH", inst.fetch_cycle, inst.dispatch_cycle);
+    stage(inst.tag, "DISP", inst.dispatch_cycle, inst.schedule_cycle);
+    stage(inst.tag, "SCHED", inst.schedule_cycle, inst.execute_cycle);
+    stage(inst.tag, "EXEC", inst.execute_cycle, inst.broadcast_cycle);
+    stage(inst.tag, "ROB", inst.broadcast_cycle, inst.state_update_cycle);   // Waiting to commit
+    stage(inst.tag, "STATE", inst.state_update_cycle, end);
+    writer.printf(",\n{\"name\":\"%lu\",\"cat\":\"inst\",\"ph\":\"e\",\"id\":%lu,\"pid\":%d,\"ts\":%lu}",
+                  inst.tag, inst.tag, TRACE_PID_INSTRUCTIONS, end);
+
+    // FU occupancy: a blocking FU is held until the broadcast, a pipelined one for its interval
+    int t = inst.fu_type;
+    uint64_t held = (fu_interval[t] == 0) ? inst.broadcast_cycle - inst.execute_cycle : fu_interval[t];
+    writer.printf(",\n{\"name\":\"%lu\",\"ph\":\"X\",\"pid\":%d,\"tid\":%lu,\"ts\":%lu,\"dur\":%lu}",
+                  inst.tag, TRACE_PID_FUS, t * 1000000 + (uint64_t)inst.fu_id, inst.execute_cycle,
+                  held > 0 ? held : 1);
+}
+
+void PipelineTrace::result_buses(uint64_t cycle, uint64_t granted, uint64_t waiting)
+{
+    if (!enabled() || (granted == last_granted && waiting == last_waiting)) {
+        return;
+    }
+    writer.printf(",\n{\"name\":\"result_buses\",\"ph\":\"C\",\"pid\":%d,\"ts\":%lu,"
+                  "\"args\":{\"granted\":%lu,\"waiting\":%lu}}",
+                  TRACE_PID_BUSES, cycle, granted, waiting);
+    last_granted = granted;
+    last_waiting = waiting;
+}
+
+void PipelineTrace::finish()
+{
+    if (!enabled()) {
+        return;
+    }
+    writer.printf("\n]\n");
+    writer.close();
+}
@@ -0,0 +1,127 @@
+#ifndef PROCSIM_TELEMETRY_HPP
+#define PROCSIM_TELEMETRY_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "procsim.hpp"
+
+// Streaming run telemetry: an interval time series (IntervalLog) and a Chrome
+// trace-event timeline (PipelineTrace). Both format into a BufferedWriter, so output
+// reaches the stream in large writes and memory does not grow with the run.
+
+// Formats text into a fixed buffer and writes it out whenever it fills
+class BufferedWriter {
+public:
+    BufferedWriter();
+
+    void open(FILE* out);               // NULL = closed
+    bool is_open() const { return out != NULL; }
+    void printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void close();                       // Flush and detach (the stream stays open)
+
+private:
+    void flush();
+
+    FILE* out;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+// Interval time series: every N cycles one CSV row summarizes the interval just ended
+// (IPC, fire rate, average RS occupancy and dispatch queue depth, result-bus usage), so
+// program phases stay visible without a per-instruction log.
+
+// Running totals the processor exposes at each sample point
+typedef struct _interval_totals_t
+{
+    uint64_t cycle;            // Last cycle included
+    uint64_t retired;
+    uint64_t fired;
+    uint64_t disp_size_sum;    // Sum over cycles of the dispatch queue size
+    uint64_t rs_size_sum;      // Sum over cycles of the RS occupancy
+    uint64_t bus_broadcasts;   // Result-bus slots used
+} interval_totals_t;
+
+class IntervalLog {
+public:
+    IntervalLog();
+
+    /**
+     * Start a time series on out (NULL or interval 0 disables it) and write the CSV header
+     * @interval Cycles per row
+     * @num_buses R, for the result-bus utilization column
+     */
+    void open(FILE* out, uint64_t interval, uint64_t num_buses);
+
+    bool enabled() const { return writer.is_open(); }
+
+    // Cycle at whose end the next row is due
+    uint64_t next_sample() const { return last.cycle + interval; }
+
+    /**
+     * Emit the row for the interval ending at totals.cycle (== next_sample())
+     */
+    void sample(const interval_totals_t& totals);
+
+    /**
+     * Emit the final, possibly shorter interval and flush, then stop
+     */
+    void finish(const interval_totals_t& totals);
+
+private:
+    BufferedWriter writer;
+    uint64_t interval;
+    uint64_t num_buses;
+    interval_totals_t last;    // Totals at the previous row
+};
+
+// Chrome trace-event (JSON array) export of the pipeline, loadable in Perfetto or
+// chrome://tracing, with 1 cycle shown as 1 us:
+//   - "Instructions": one async slice per instruction with FETCH/DISP/SCHED/EXEC/STATE
+//     sub-slices, plus ROB while waiting to commit (async, so overlapping lifetimes get
+//     their own lanes)
+//   - "Function units": one track per FU with a slice per occupancy (fire to broadcast
+//     for blocking FUs, fire to next issue slot for pipelined ones)
+//   - "Result buses": counters of granted and waiting results, emitted on change
+// Events are written as instructions retire, so they are not globally time-sorted
+// (the trace viewers sort on load).
+class PipelineTrace {
+public:
+    PipelineTrace();
+
+    /**
+     * Start a trace on out (NULL disables it) and write the track names
+     * @num_fus FU count per type
+     * @fu_timing Timing per FU type, for the length of pipelined FU occupancy
+     */
+    void open(FILE* out, const uint64_t num_fus[3], const fu_timing_t fu_timing[3]);
+
+    bool enabled() const { return writer.is_open(); }
+
+    /**
+     * Emit the stage slices and FU occupancy of a retired instruction
+     */
+    void record(const proc_inst_t& inst);
+
+    /**
+     * Result-bus counters at the given cycle (written only when they change)
+     */
+    void result_buses(uint64_t cycle, uint64_t granted, uint64_t waiting);
+
+    /**
+     * Close the JSON array and flush, then stop
+     */
+    void finish();
+
+private:
+    void stage(uint64_t tag, const char* name, uint64_t begin, uint64_t end);
+
+    BufferedWriter writer;
+    uint64_t fu_interval[3];
+    uint64_t last_granted;
+    uint64_t last_waiting;
+};
+
+#endif /* PROCSIM_TELEMETRY_HPP */
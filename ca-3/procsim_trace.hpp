@@ -0,0 +1,210 @@
+#ifndef PROCSIM_TRACE_HPP
+#define PROCSIM_TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "procsim.hpp"
+
+// Binary trace format (written by trace2bin, read by procsim_driver)
+//
+//   header:  trace_bin_header_t (24 bytes)
+//   records: record_count x trace_bin_record_t (8 bytes each), or, in an annotated trace
+//            (version 2, trace2bin -d), record_count x trace_dep_record_t (16 bytes each)
+//
+// Headers and records are raw structs in the byte order of the host that wrote them
+// (no swapping, so a trace can be mapped as is). A trace from a host with the other byte
+// order is recognized by its byte-swapped version field and rejected, not misread.
+// Registers and op codes are stored as int8_t, which
+// covers every value the simulator accepts (op codes -1..2, registers -1..127).
+// The first magic byte is not printable ASCII, so a text trace can never be
+// mistaken for a binary one.
+
+#define TRACE_BIN_MAGIC   "\x89PRCTRC\n"
+#define TRACE_BIN_VERSION 1
+#define TRACE_BIN_VERSION_DEPS 2    // Records annotated with producer distances
+
+typedef struct _trace_bin_header_t
+{
+    char magic[8];              // TRACE_BIN_MAGIC
+    uint32_t version;           // TRACE_BIN_VERSION
+    uint32_t record_size;       // sizeof(trace_bin_record_t)
+    uint64_t record_count;      // Number of records following the header
+} trace_bin_header_t;
+
+typedef struct _trace_bin_record_t
+{
+    uint32_t instruction_address;
+    int8_t op_code;
+    int8_t dest_reg;
+    int8_t src_reg[2];
+} trace_bin_record_t;
+
+// Annotated record: the instruction plus, for each source, the distance in instructions
+// back to its producer (the latest earlier instruction writing that register), 0 = none.
+// Producers depend only on program order, so this is computed once per trace instead of
+// in every simulation. Distances that do not fit 32 bits are stored as 0.
+typedef struct _trace_dep_record_t
+{
+    trace_bin_record_t inst;
+    uint32_t src_distance[2];
+} trace_dep_record_t;
+
+static_assert(sizeof(trace_bin_header_t) == 24, "trace header must stay 24 bytes");
+static_assert(sizeof(trace_bin_record_t) == 8, "trace records must stay 8 bytes");
+static_assert(sizeof(trace_dep_record_t) == 16, "annotated trace records must stay 16 bytes");
+
+inline bool trace_bin_header_valid(const trace_bin_header_t* h)
+{
+    return memcmp(h->magic, TRACE_BIN_MAGIC, sizeof(h->magic)) == 0 &&
+           ((h->version == TRACE_BIN_VERSION && h->record_size == sizeof(trace_bin_record_t)) ||
+            (h->version == TRACE_BIN_VERSION_DEPS && h->record_size == sizeof(trace_dep_record_t)));
+}
+
+// Valid magic, but the version only makes sense byte-swapped: written on a host with the
+// other byte order
+inline bool trace_bin_foreign_byte_order(const trace_bin_header_t* h)
+{
+    uint32_t swapped = __builtin_bswap32(h->version);
+    return memcmp(h->magic, TRACE_BIN_MAGIC, sizeof(h->magic)) == 0 &&
+           (swapped == TRACE_BIN_VERSION || swapped == TRACE_BIN_VERSION_DEPS);
+}
+
+inline bool trace_bin_has_deps(const trace_bin_header_t* h)
+{
+    return h->version == TRACE_BIN_VERSION_DEPS;
+}
+
+/**
+ * Pack the trace fields of an instruction into a binary record
+ * @return false if a field does not fit the record encoding
+ */
+inline bool trace_bin_encode(const proc_inst_t* inst, trace_bin_record_t* rec)
+{
+    if (inst->op_code < -128 || inst->op_code > 127 ||
+        inst->dest_reg < -128 || inst->dest_reg > 127 ||
+        inst->src_reg[0] < -128 || inst->src_reg[0] > 127 ||
+        inst->src_reg[1] < -128 || inst->src_reg[1] > 127) {
+        return false;
+    }
+    rec->instruction_address = inst->instruction_address;
+    rec->op_code = (int8_t)inst->op_code;
+    rec->dest_reg = (int8_t)inst->dest_reg;
+    rec->src_reg[0] = (int8_t)inst->src_reg[0];
+    rec->src_reg[1] = (int8_t)inst->src_reg[1];
+    return true;
+}
+
+/**
+ * Unpack a binary record into the trace fields of an instruction
+ */
+inline void trace_bin_decode(const trace_bin_record_t* rec, proc_inst_t* inst)
+{
+    inst->instruction_address = rec->instruction_address;
+    inst->op_code = rec->op_code;
+    inst->dest_reg = rec->dest_reg;
+    inst->src_reg[0] = rec->src_reg[0];
+    inst->src_reg[1] = rec->src_reg[1];
+    inst->has_src_distance = false;
+}
+
+/**
+ * Unpack an annotated record, producer distances included
+ */
+inline void trace_dep_decode(const trace_dep_record_t* rec, proc_inst_t* inst)
+{
+    trace_bin_decode(&rec->inst, inst);
+    inst->src_distance[0] = rec->src_distance[0];
+    inst->src_distance[1] = rec->src_distance[1];
+    inst->has_src_distance = true;
+}
+
+/**
+ * Read the next whitespace-separated number of a text trace the way fscanf's %x (base 16)
+ * or %d (base 10) would, without fscanf's per-call format parsing and locking. The stream
+ * must not be read by another thread at the same time.
+ * @return false at end of input or if no digits follow
+ */
+inline bool trace_text_field(FILE* in, int base, uint32_t* value)
+{
+    int c;
+    do {
+        c = getc_unlocked(in);
+    } while (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f');
+    bool negative = (c == '-');
+    if (c == '-' || c == '+') {
+        c = getc_unlocked(in);
+    }
+    bool digits = false;
+    if (base == 16 && c == '0') {
+        digits = true;
+        c = getc_unlocked(in);
+        if (c == 'x' || c == 'X') {
+            c = getc_unlocked(in);
+        }
+    }
+    uint32_t n = 0;
+    for (;; c = getc_unlocked(in)) {
+        int d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            d = c - 'a' + 10;
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            d = c - 'A' + 10;
+        } else {
+            break;
+        }
+        n = n * base + d;
+        digits = true;
+    }
+    ungetc(c, in);
+    *value = negative ? 0u - n : n;
+    return digits;
+}
+
+/**
+ * Read the next instruction of a text trace ("%x %d %d %d %d": address, op code,
+ * destination and source registers)
+ * @return false at end of input or on a malformed line
+ */
+inline bool trace_text_read(FILE* in, proc_inst_t* inst)
+{
+    uint32_t fields[4];
+    if (!trace_text_field(in, 16, &inst->instruction_address) || !trace_text_field(in, 10, &fields[0]) ||
+        !trace_text_field(in, 10, &fields[1]) || !trace_text_field(in, 10, &fields[2]) ||
+        !trace_text_field(in, 10, &fields[3])) {
+        return false;
+    }
+    inst->op_code = (int32_t)fields[0];
+    inst->dest_reg = (int32_t)fields[1];
+    inst->src_reg[0] = (int32_t)fields[2];
+    inst->src_reg[1] = (int32_t)fields[3];
+    inst->has_src_distance = false;
+    return true;
+}
+
+// Producer distances of a trace, computed in one pass in program order
+struct TraceDepAnnotator {
+    uint64_t last_writer[NUM_ARCH_REGS];   // Position (1-based) of the latest writer, 0 = none
+    uint64_t count;                        // Instructions annotated so far
+
+    TraceDepAnnotator() { reset(); }
+    void reset() { memset(last_writer, 0, sizeof(last_writer)); count = 0; }
+
+    // Sources are read before the destination is written, like dispatch does
+    void annotate(const proc_inst_t* inst, uint32_t distance[2])
+    {
+        count++;
+        for (int s = 0; s < 2; s++) {
+            int32_t reg = inst->src_reg[s];
+            uint64_t d = (reg >= 0 && reg < NUM_ARCH_REGS && last_writer[reg] != 0) ? count - last_writer[reg] : 0;
+            distance[s] = (d > UINT32_MAX) ? 0 : (uint32_t)d;
+        }
+        if (inst->dest_reg >= 0 && inst->dest_reg < NUM_ARCH_REGS) {
+            last_writer[inst->dest_reg] = count;
+        }
+    }
+};
+
+#endif /* PROCSIM_TRACE_HPP */
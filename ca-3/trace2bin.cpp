@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "procsim_trace.hpp"
+
+// trace2bin: convert a text trace ("%x %d %d %d %d" per line) into the binary
+// trace format of procsim_trace.hpp, so repeated simulations skip text parsing.
+// With -d the records are annotated with their producer distances, so simulations
+// also skip the dependence analysis.
+
+void print_help_and_exit(void) {
+    printf("trace2bin [OPTIONS]\n");
+    printf("  -i traces/file.trace\tText trace to convert (default: stdin)\n");
+    printf("  -o traces/file.bin\tBinary trace to write\n");
+    printf("  -d\t\t\tAnnotate each record with the distance to its producers\n");
+    printf("  -h\t\t\tThis helpful output\n");
+    exit(0);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    FILE* in = stdin;
+    const char* out_path = NULL;
+    bool annotate = false;
+
+    while(-1 != (opt = getopt(argc, argv, "i:o:dh"))) {
+        switch(opt) {
+        case 'i':
+            in = fopen(optarg, "r");
+            if (in == NULL)
+            {
+                fprintf(stderr, "Failed to open %s for reading\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'd':
+            annotate = true;
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help_and_exit();
+            break;
+        }
+    }
+
+    if (out_path == NULL) {
+        fprintf(stderr, "An output file is required (-o)\n");
+        print_help_and_exit();
+    }
+
+    FILE* out = fopen(out_path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to open %s for writing\n", out_path);
+        return 1;
+    }
+
+    // Header is written first with a zero count and patched once the count is known
+    trace_bin_header_t header;
+    memcpy(header.magic, TRACE_BIN_MAGIC, sizeof(header.magic));
+    header.version = annotate ? TRACE_BIN_VERSION_DEPS : TRACE_BIN_VERSION;
+    header.record_size = annotate ? sizeof(trace_dep_record_t) : sizeof(trace_bin_record_t);
+    header.record_count = 0;
+    bool written = (fwrite(&header, sizeof(header), 1, out) == 1);
+
+    proc_inst_t inst;
+    trace_dep_record_t rec;
+    TraceDepAnnotator annotator;
+    while (written && trace_text_read(in, &inst)) {
+        annotator.annotate(&inst, rec.src_distance);
+        if (!trace_bin_encode(&inst, &rec.inst)) {
+            fprintf(stderr, "Instruction %" PRIu64 " has a field out of range for the binary format\n",
+                    header.record_count + 1);
+            fclose(out);
+            remove(out_path);
+            return 1;
+        }
+        written = (fwrite(&rec, header.record_size, 1, out) == 1);
+        header.record_count++;
+    }
+
+    // Patch the count into the header; a failed write anywhere leaves the output incomplete
+    written = written && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    bool closed = (fclose(out) == 0);
+    if (!written || !closed) {
+        fprintf(stderr, "Failed to write %s\n", out_path);
+        remove(out_path);
+        return 1;
+    }
+
+    fprintf(stderr, "Wrote %" PRIu64 " instructions to %s\n", header.record_count, out_path);
+    return 0;
+}